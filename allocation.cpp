@@ -0,0 +1,83 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+
+#include "allocation.hpp"
+
+greplace::CountingAllocator::CountingAllocator(void) : count(0), total(0) { }
+
+void greplace::CountingAllocator::allocate(int dims, const int * sizes,
+                                           int type, int * & refcount,
+                                           uchar * & datastart, uchar * & data,
+                                           size_t * step) {
+  size_t length = CV_ELEM_SIZE(type);
+  for (int i = dims - 1; i >= 0; i --) {
+    if (step != NULL) {
+      step[i] = length;
+    }
+    length *= sizes[i];
+  }
+  /* Laid out as cv::Mat does it, with the reference count after the data */
+  uchar * p = static_cast<uchar *>(cv::fastMalloc(length + sizeof(int)));
+  data = datastart = p;
+  refcount = reinterpret_cast<int *>(p + length);
+  *refcount = 1;
+  count++;
+  total += length;
+}
+
+void greplace::CountingAllocator::deallocate(int * refcount,
+                                             uchar * datastart,
+                                             uchar * data) {
+  cv::fastFree(datastart);
+}
+
+size_t greplace::CountingAllocator::allocations(void) const {
+  return count.load();
+}
+
+size_t greplace::CountingAllocator::bytes(void) const {
+  return total.load();
+}
+
+greplace::CountingAllocator & greplace::counting_allocator(void) {
+  static greplace::CountingAllocator allocator;
+  return allocator;
+}
+
+void greplace::count_allocations(cv::Mat & m) {
+  m.allocator = &greplace::counting_allocator();
+}
+
+cv::Mat greplace::scratch(cv::Mat & storage, cv::Size size, int type) {
+  if (storage.type() != type || storage.rows < size.height ||
+      storage.cols < size.width) {
+    storage.create(std::max(storage.rows, size.height),
+                   std::max(storage.cols, size.width), type);
+  }
+  return storage(cv::Rect(0, 0, size.width, size.height));
+}
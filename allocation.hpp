@@ -0,0 +1,65 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_ALLOCATION_HPP
+#define _GREPLACE_ALLOCATION_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+
+#include <stddef.h>
+
+namespace greplace {
+  /*
+   * A cv::MatAllocator that counts the buffers and bytes it hands out. Only
+   * Mats that have been given it through count_allocations are counted, so
+   * this covers greplace's own images and not memory OpenCV uses internally.
+   */
+  class CountingAllocator : public cv::MatAllocator {
+  public:
+    CountingAllocator(void);
+    void allocate(int dims, const int * sizes, int type, int * & refcount,
+                  uchar * & datastart, uchar * & data, size_t * step);
+    void deallocate(int * refcount, uchar * datastart, uchar * data);
+    size_t allocations(void) const;
+    size_t bytes(void) const;
+  private:
+    std::atomic<size_t> count;
+    std::atomic<size_t> total;
+  };
+
+  CountingAllocator & counting_allocator(void);
+
+  /* Has M's future buffers come from the counting allocator */
+  void count_allocations(cv::Mat & m);
+
+  /*
+   * Returns a SIZE view of STORAGE, growing STORAGE first if it is too small.
+   * Buffers sized once for the largest image never allocate again.
+   */
+  cv::Mat scratch(cv::Mat & storage, cv::Size size, int type);
+}
+
+#endif
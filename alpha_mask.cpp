@@ -0,0 +1,89 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+
+#include <math.h>
+
+#include "alpha_mask.hpp"
+#include "allocation.hpp"
+#include "kernels.hpp"
+
+const int greplace::ALPHA_MASK_QUANTUM = 8;
+
+static int quantize(int n) {
+  int q = greplace::ALPHA_MASK_QUANTUM;
+  return std::max(q, (n + q / 2) / q * q);
+}
+
+greplace::AlphaMaskCache::AlphaMaskCache(size_t capacity)
+  : capacity(capacity) { }
+
+cv::Mat greplace::AlphaMaskCache::mask(cv::Size size, double r0, double rf,
+                                       bool reverse, cv::Mat & storage) {
+  cv::Size key(quantize(size.width), quantize(size.height));
+  std::list<Entry>::iterator it = entries.begin();
+  while (it != entries.end() && (it->size != key || it->r0 != r0 ||
+                                 it->rf != rf || it->reverse != reverse)) {
+    ++it;
+  }
+  if (it == entries.end()) {
+    if (entries.size() >= capacity) {
+      entries.pop_back();
+    }
+    Entry entry;
+    entry.size = key;
+    entry.r0 = r0;
+    entry.rf = rf;
+    entry.reverse = reverse;
+    entry.mask = greplace::radial_alpha_mask(key, r0, rf, reverse);
+    entries.push_front(entry);
+  } else if (it != entries.begin()) {
+    entries.splice(entries.begin(), entries, it);
+  }
+  const cv::Mat & found = entries.front().mask;
+  if (key == size) {
+    return found;
+  }
+  cv::Mat resampled = greplace::scratch(storage, size, CV_8UC1);
+  cv::resize(found, resampled, size, 0, 0, cv::INTER_LINEAR);
+  return resampled;
+}
+
+cv::Mat greplace::radial_alpha_mask(cv::Size size, double r0, double rf,
+                                    bool reverse) {
+  cv::Mat mask(size, CV_8UC1);
+  double centre_row = static_cast<double>(size.height) / 2;
+  double centre_col = static_cast<double>(size.width) / 2;
+  double max_dist = sqrt(centre_row * centre_row + centre_col * centre_col);
+  const greplace::KernelTable & k = greplace::kernels();
+  for (int row = 0; row < size.height; row ++) {
+    k.alpha_mask_row(row - centre_row, centre_col, max_dist, r0, rf, reverse,
+                     mask.ptr<uchar>(row), size.width);
+  }
+  return mask;
+}
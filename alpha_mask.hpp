@@ -0,0 +1,69 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_ALPHA_MASK_HPP
+#define _GREPLACE_ALPHA_MASK_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <list>
+
+#include <stddef.h>
+
+namespace greplace {
+  /*
+   * Radial alpha masks for the circular filters, built once per size and
+   * reused. Sizes are rounded to a multiple of ALPHA_MASK_QUANTUM, and a
+   * mask for any other size is resampled from the nearest one, so faces
+   * that grow and shrink by a few pixels share masks. The least recently
+   * used mask is dropped once the cache holds its capacity.
+   */
+  class AlphaMaskCache {
+  public:
+    explicit AlphaMaskCache(size_t capacity);
+    /*
+     * The mask for SIZE, opaque inside r0 and clear outside rf (the reverse
+     * if REVERSE). Resampled masks are written to STORAGE.
+     */
+    cv::Mat mask(cv::Size size, double r0, double rf, bool reverse,
+                 cv::Mat & storage);
+  private:
+    struct Entry {
+      cv::Size size;
+      double r0;
+      double rf;
+      bool reverse;
+      cv::Mat mask;
+    };
+    std::list<Entry> entries;
+    size_t capacity;
+  };
+
+  extern const int ALPHA_MASK_QUANTUM;
+
+  /* Builds the mask for exactly SIZE, as the filters always computed it */
+  cv::Mat radial_alpha_mask(cv::Size size, double r0, double rf, bool reverse);
+}
+
+#endif
@@ -0,0 +1,300 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+#include <string>
+#include <iostream>
+#include <sstream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "capture.hpp"
+
+static bool ends_with(const std::string & s, const char * suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+greplace::OpenCVCapture::OpenCVCapture(const char * path, int device,
+                                       cv::Size size)
+  : frame_size(size), frame_rate(0) {
+  if (path != NULL) {
+    if (!capture.open(path)) {
+      return;
+    }
+    /* Recorded footage sets the resolution, not the command line */
+    int width  = static_cast<int>(capture.get(CV_CAP_PROP_FRAME_WIDTH));
+    int height = static_cast<int>(capture.get(CV_CAP_PROP_FRAME_HEIGHT));
+    if (width > 0 && height > 0) {
+      frame_size = cv::Size(width, height);
+    }
+  } else {
+    capture.open(device);
+    capture.set(CV_CAP_PROP_FRAME_WIDTH,  size.width);
+    capture.set(CV_CAP_PROP_FRAME_HEIGHT, size.height);
+    capture.grab();
+  }
+  frame_rate = std::max(capture.get(CV_CAP_PROP_FPS), 0.0);
+}
+
+bool greplace::OpenCVCapture::opened(void) const {
+  return capture.isOpened();
+}
+
+bool greplace::OpenCVCapture::read(greplace::FrameContext & frame, bool keep) {
+  capture >> image;
+  if (image.empty()) {
+    return false;
+  }
+  /* The capture device reuses its buffer for the next frame */
+  frame.reset(keep ? image.clone() : image);
+  return true;
+}
+
+cv::Size greplace::OpenCVCapture::size(void) const {
+  return frame_size;
+}
+
+double greplace::OpenCVCapture::fps(void) const {
+  return frame_rate;
+}
+
+bool greplace::OpenCVCapture::colour(void) const {
+  return true;
+}
+
+greplace::YuvCapture::YuvCapture(std::string path, cv::Size raw_size)
+  : y4m(raw_size.area() == 0), frame_size(raw_size), chroma_bytes(0),
+    frame_rate(0), stream(NULL), map(NULL), map_length(0), offset(0),
+    released(0), failed(true) {
+  stream = (path == "-") ? stdin : fopen(path.c_str(), "rb");
+  if (stream == NULL) {
+    std::cout << "greplace: Could not open " << path << std::endl;
+    return;
+  }
+  struct stat status;
+  if (fstat(fileno(stream), &status) == 0 && S_ISREG(status.st_mode) &&
+      status.st_size > 0) {
+    /* Read only; the frame copies the luma before compose draws on it */
+    void * mapped = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE,
+                         fileno(stream), 0);
+    if (mapped != MAP_FAILED) {
+      map = static_cast<uchar *>(mapped);
+      map_length = status.st_size;
+      madvise(map, map_length, MADV_SEQUENTIAL);
+    }
+  }
+  if (y4m) {
+    std::string header;
+    if (!read_line(header) || !parse_header(header)) {
+      std::cout << "greplace: " << path << " is not a YUV4MPEG2 stream ";
+      std::cout << "greplace can read" << std::endl;
+      return;
+    }
+  } else {
+    /* I420: quarter size U and V planes */
+    chroma_bytes = 2 * static_cast<size_t>((frame_size.width + 1) / 2) *
+                   ((frame_size.height + 1) / 2);
+  }
+  failed = false;
+}
+
+greplace::YuvCapture::~YuvCapture(void) {
+  if (map != NULL) {
+    munmap(map, map_length);
+  }
+  if (stream != NULL && stream != stdin) {
+    fclose(stream);
+  }
+}
+
+bool greplace::YuvCapture::parse_header(const std::string & header) {
+  std::istringstream tokens(header);
+  std::string token;
+  tokens >> token;
+  if (token != "YUV4MPEG2") {
+    return false;
+  }
+  std::string colourspace = "420";
+  while (tokens >> token) {
+    switch (token[0]) {
+    case 'W':
+      frame_size.width = atoi(token.c_str() + 1);
+      break;
+    case 'H':
+      frame_size.height = atoi(token.c_str() + 1);
+      break;
+    case 'F': {
+      int numerator = 0, denominator = 0;
+      if (sscanf(token.c_str() + 1, "%d:%d", &numerator, &denominator) == 2 &&
+          denominator > 0) {
+        frame_rate = static_cast<double>(numerator) / denominator;
+      }
+      break;
+    }
+    case 'C':
+      colourspace = token.substr(1);
+      break;
+    }
+  }
+  if (frame_size.width <= 0 || frame_size.height <= 0) {
+    return false;
+  }
+  size_t half_width = (frame_size.width + 1) / 2;
+  size_t half_height = (frame_size.height + 1) / 2;
+  /* 8 bit only; C420p10 and the like have two bytes a sample */
+  if (colourspace == "420" || colourspace == "420jpeg" ||
+      colourspace == "420paldv" || colourspace == "420mpeg2") {
+    chroma_bytes = 2 * half_width * half_height;
+  } else if (colourspace == "422") {
+    chroma_bytes = 2 * half_width * frame_size.height;
+  } else if (colourspace == "444") {
+    chroma_bytes = 2 * static_cast<size_t>(frame_size.area());
+  } else if (colourspace == "mono") {
+    chroma_bytes = 0;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool greplace::YuvCapture::read_line(std::string & line) {
+  line.clear();
+  if (map != NULL) {
+    const void * end = memchr(map + offset, '\n', map_length - offset);
+    if (end == NULL) {
+      return false;
+    }
+    size_t length = static_cast<const uchar *>(end) - (map + offset);
+    line.assign(reinterpret_cast<const char *>(map + offset), length);
+    offset += length + 1;
+    return true;
+  }
+  int c;
+  while ((c = getc(stream)) != EOF && c != '\n') {
+    line.push_back(static_cast<char>(c));
+  }
+  return c == '\n';
+}
+
+bool greplace::YuvCapture::read_bytes(void * data, size_t length) {
+  return fread(data, 1, length, stream) == length;
+}
+
+bool greplace::YuvCapture::skip_bytes(size_t length) {
+  char discard[4096];
+  while (length > 0) {
+    size_t n = std::min(length, sizeof(discard));
+    if (!read_bytes(discard, n)) {
+      return false;
+    }
+    length -= n;
+  }
+  return true;
+}
+
+bool greplace::YuvCapture::opened(void) const {
+  return !failed;
+}
+
+bool greplace::YuvCapture::read(greplace::FrameContext & frame, bool keep) {
+  if (failed) {
+    return false;
+  }
+  std::string line;
+  if (y4m && (!read_line(line) || line.compare(0, 5, "FRAME") != 0)) {
+    return false;
+  }
+  size_t luma_bytes = static_cast<size_t>(frame_size.area());
+  if (map != NULL) {
+    if (map_length - offset < luma_bytes + chroma_bytes) {
+      return false;
+    }
+    if (!keep) {
+      /* Nothing holds the earlier frames now, so their pages can go */
+      size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+      size_t consumed = offset / page * page;
+      if (consumed > released) {
+        madvise(map + released, consumed - released, MADV_DONTNEED);
+        released = consumed;
+      }
+    }
+    /* The mapping outlives every frame, so KEEP costs nothing here */
+    frame.reset_grey(cv::Mat(frame_size, CV_8UC1, map + offset), true);
+    offset += luma_bytes + chroma_bytes;
+    return true;
+  }
+  if (keep) {
+    /* The frame keeps the last buffer; read into a new one */
+    buffer = cv::Mat();
+  }
+  buffer.create(frame_size, CV_8UC1);
+  if (!read_bytes(buffer.data, luma_bytes) || !skip_bytes(chroma_bytes)) {
+    return false;
+  }
+  frame.reset_grey(buffer);
+  return true;
+}
+
+cv::Size greplace::YuvCapture::size(void) const {
+  return frame_size;
+}
+
+double greplace::YuvCapture::fps(void) const {
+  return frame_rate;
+}
+
+bool greplace::YuvCapture::colour(void) const {
+  return false;
+}
+
+greplace::Capture * greplace::create_capture(const char * path, int device,
+                                             cv::Size size) {
+  std::string p = (path != NULL) ? path : "";
+  if (p == "-" || ends_with(p, ".y4m") || ends_with(p, ".yuv")) {
+    greplace::YuvCapture * capture =
+        new greplace::YuvCapture(p, ends_with(p, ".yuv") ? size : cv::Size());
+    if (!capture->opened()) {
+      delete capture;
+      return NULL;
+    }
+    return capture;
+  }
+  greplace::OpenCVCapture * capture =
+      new greplace::OpenCVCapture(path, device, size);
+  if (path != NULL && !capture->opened()) {
+    std::cout << "greplace: Could not open " << path << std::endl;
+    delete capture;
+    return NULL;
+  }
+  return capture;
+}
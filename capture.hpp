@@ -0,0 +1,119 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_CAPTURE_HPP
+#define _GREPLACE_CAPTURE_HPP
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <string>
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "frame_context.hpp"
+
+namespace greplace {
+  /* Where the main loops get their frames from */
+  class Capture {
+  public:
+    virtual ~Capture(void) { }
+    /*
+     * Moves FRAME on to the next frame, returning false at the end of the
+     * input. Unless KEEP is set, the frame may share a buffer that the next
+     * read overwrites.
+     */
+    virtual bool read(greplace::FrameContext & frame, bool keep = false) = 0;
+    virtual cv::Size size(void) const = 0;
+    /* Frames per second, or 0 if the source does not say */
+    virtual double fps(void) const = 0;
+    /* False if frames only have a luma plane */
+    virtual bool colour(void) const = 0;
+  };
+
+  /* Webcams, video files and image sequences, decoded to BGR by OpenCV */
+  class OpenCVCapture : public Capture {
+  public:
+    /* Opens PATH, or webcam DEVICE at SIZE if PATH is NULL */
+    OpenCVCapture(const char * path, int device, cv::Size size);
+    bool opened(void) const;
+    bool read(greplace::FrameContext & frame, bool keep = false);
+    cv::Size size(void) const;
+    double fps(void) const;
+    bool colour(void) const;
+  private:
+    cv::VideoCapture capture;
+    cv::Mat image;
+    cv::Size frame_size;
+    double frame_rate;
+  };
+
+  /*
+   * Reads YUV4MPEG2 streams, or headerless I420 when the size is given,
+   * from a file, a pipe or stdin ("-"). Only the Y plane is used; it goes
+   * to the frame as its grey plane without conversion. Regular files are
+   * mapped read only, so detection works on views of the mapping and a
+   * frame is copied only when compose draws on it; pages of frames that
+   * are finished with are dropped. Streams are read into a buffer instead.
+   */
+  class YuvCapture : public Capture {
+  public:
+    /* RAW_SIZE is the frame size of headerless input, empty for Y4M */
+    YuvCapture(std::string path, cv::Size raw_size);
+    ~YuvCapture(void);
+    bool opened(void) const;
+    bool read(greplace::FrameContext & frame, bool keep = false);
+    cv::Size size(void) const;
+    double fps(void) const;
+    bool colour(void) const;
+  private:
+    bool parse_header(const std::string & header);
+    bool read_line(std::string & line);
+    bool read_bytes(void * data, size_t length);
+    bool skip_bytes(size_t length);
+    bool y4m;
+    cv::Size frame_size;
+    /* Bytes of chroma after each Y plane */
+    size_t chroma_bytes;
+    double frame_rate;
+    FILE * stream;
+    uchar * map;
+    size_t map_length;
+    size_t offset;
+    /* The mapping before this is dropped */
+    size_t released;
+    cv::Mat buffer;
+    bool failed;
+  };
+
+  /*
+   * Opens PATH: .y4m files and "-" as YUV4MPEG2, .yuv files as I420 of
+   * SIZE, anything else through OpenCV. With no PATH, opens webcam DEVICE
+   * at SIZE. Returns NULL if the input cannot be opened.
+   */
+  Capture * create_capture(const char * path, int device, cv::Size size);
+}
+
+#endif
@@ -0,0 +1,367 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cascade_cache.hpp"
+#include "cascade_xml.hpp"
+#include "haar.hpp"
+
+static const char CACHE_MAGIC[8] = { 'G', 'R', 'H', 'A', 'A', 'R', '1', 0 };
+
+/*
+ * The cache file starts with this, then holds the stages and the stumps as
+ * they are in memory. The sizes guard against a build with another layout.
+ */
+struct CacheHeader {
+  char magic[8];
+  unsigned long long xml_hash;
+  unsigned int stage_size, stump_size;
+  int window_width, window_height;
+  int stage_count, stump_count;
+};
+
+static bool read_file(const char * path, std::string & text) {
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  if (!in) {
+    return false;
+  }
+  std::stringstream contents;
+  contents << in.rdbuf();
+  text = contents.str();
+  return true;
+}
+
+/*
+ * Checks a mapped cache as strictly as the parser checks XML: stages that
+ * tile the stump table in order, flags that are real bools and agree with
+ * their stumps, and rectangles inside the window.
+ */
+static bool valid_tables(const greplace::HaarCascadeData & data) {
+  if (data.window_width <= 2 || data.window_height <= 2) {
+    return false;
+  }
+  for (int i = 0; i < data.stump_count; i ++) {
+    const greplace::HaarStump & stump = data.stumps[i];
+    if (stump.rect_count < 2 || stump.rect_count > 3) {
+      return false;
+    }
+    for (int j = 0; j < stump.rect_count; j ++) {
+      if (!greplace::haar_rect_inside(stump.rects[j], data.window_width,
+                                      data.window_height)) {
+        return false;
+      }
+    }
+  }
+  int next = 0;
+  for (int i = 0; i < data.stage_count; i ++) {
+    const greplace::HaarStage & stage = data.stages[i];
+    if (stage.first != next || stage.count < 0 ||
+        stage.count > data.stump_count - stage.first) {
+      return false;
+    }
+    next = stage.first + stage.count;
+    /* Read as a byte: a mapped bool other than 0 or 1 is undefined */
+    unsigned char flag;
+    memcpy(&flag, &stage.two_rects, 1);
+    if (flag > 1) {
+      return false;
+    }
+    bool two_rects = true;
+    for (int j = stage.first; j < next; j ++) {
+      if (data.stumps[j].rect_count > 2) {
+        two_rects = false;
+      }
+    }
+    if ((flag == 1) != two_rects) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* The cache at PATH if it holds the cascade hashing to HASH, else NULL */
+static const greplace::HaarCascadeData * map_cache(const std::string & path,
+                                                   unsigned long long hash) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(CacheHeader)) {
+    close(fd);
+    return NULL;
+  }
+  size_t length = static_cast<size_t>(st.st_size);
+  void * map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  const CacheHeader * header = static_cast<const CacheHeader *>(map);
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      header->xml_hash != hash ||
+      header->stage_size != sizeof(greplace::HaarStage) ||
+      header->stump_size != sizeof(greplace::HaarStump) ||
+      header->stage_count < 1 || header->stump_count < 1 ||
+      length != sizeof(CacheHeader) +
+                header->stage_count * sizeof(greplace::HaarStage) +
+                header->stump_count * sizeof(greplace::HaarStump)) {
+    munmap(map, length);
+    return NULL;
+  }
+  const char * tables = static_cast<const char *>(map) + sizeof(CacheHeader);
+  greplace::HaarCascadeData * data = new greplace::HaarCascadeData;
+  data->window_width = header->window_width;
+  data->window_height = header->window_height;
+  data->stage_count = header->stage_count;
+  data->stump_count = header->stump_count;
+  data->stages = reinterpret_cast<const greplace::HaarStage *>(tables);
+  data->stumps = reinterpret_cast<const greplace::HaarStump *>(
+      tables + header->stage_count * sizeof(greplace::HaarStage));
+  data->xml_hash = hash;
+  if (!valid_tables(*data)) {
+    delete data;
+    munmap(map, length);
+    return NULL;
+  }
+  return data;
+}
+
+/* Written beside PATH and renamed over it, so readers never see half */
+static bool write_cache(const std::string & path,
+                        const greplace::ParsedCascade & cascade,
+                        unsigned long long hash) {
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.xml_hash = hash;
+  header.stage_size = sizeof(greplace::HaarStage);
+  header.stump_size = sizeof(greplace::HaarStump);
+  header.window_width = cascade.width;
+  header.window_height = cascade.height;
+  header.stage_count = static_cast<int>(cascade.stages.size());
+  header.stump_count = static_cast<int>(cascade.stumps.size());
+
+  std::ostringstream temp;
+  temp << path << ".tmp." << getpid();
+  {
+    std::ofstream out(temp.str().c_str(),
+                      std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(&cascade.stages[0]),
+              cascade.stages.size() * sizeof(greplace::HaarStage));
+    out.write(reinterpret_cast<const char *>(&cascade.stumps[0]),
+              cascade.stumps.size() * sizeof(greplace::HaarStump));
+    if (!out) {
+      unlink(temp.str().c_str());
+      return false;
+    }
+  }
+  if (rename(temp.str().c_str(), path.c_str()) != 0) {
+    unlink(temp.str().c_str());
+    return false;
+  }
+  return true;
+}
+
+/* The per user cache directory, made if missing; empty if there is none */
+static std::string cache_directory(bool make) {
+  std::string base;
+  const char * xdg = getenv("XDG_CACHE_HOME");
+  const char * home = getenv("HOME");
+  if (xdg != NULL && xdg[0] == '/') {
+    base = xdg;
+  } else if (home != NULL && home[0] != 0) {
+    base = std::string(home) + "/.cache";
+  } else {
+    return std::string();
+  }
+  std::string directory = base + "/greplace";
+  if (make) {
+    if ((mkdir(base.c_str(), 0755) != 0 && errno != EEXIST) ||
+        (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)) {
+      return std::string();
+    }
+  }
+  return directory;
+}
+
+/*
+ * Where the cache of a cascade may be, in the order tried: beside the XML,
+ * then under the per user cache directory named by the XML's hash, for
+ * when the XML's directory cannot be written.
+ */
+static std::vector<std::string> cache_paths(const char * xml_path,
+                                            unsigned long long hash,
+                                            bool make) {
+  std::vector<std::string> paths;
+  paths.push_back(std::string(xml_path) + ".cache");
+  std::string directory = cache_directory(make);
+  if (!directory.empty()) {
+    std::ostringstream name;
+    name << directory << "/" << std::hex << std::setw(16) << std::setfill('0')
+         << hash << ".cache";
+    paths.push_back(name.str());
+  }
+  return paths;
+}
+
+/* The path of the first cache the tables could be written to and mapped */
+static const greplace::HaarCascadeData * write_any_cache(
+    const char * xml_path, const greplace::ParsedCascade & parsed,
+    unsigned long long hash, std::string & written) {
+  std::vector<std::string> paths = cache_paths(xml_path, hash, true);
+  for (size_t i = 0; i < paths.size(); i ++) {
+    if (write_cache(paths[i], parsed, hash)) {
+      const greplace::HaarCascadeData * data = map_cache(paths[i], hash);
+      if (data != NULL) {
+        written = paths[i];
+        return data;
+      }
+    }
+  }
+  return NULL;
+}
+
+static bool parse_file(const char * xml_path, const std::string & xml,
+                       greplace::ParsedCascade & parsed) {
+  std::string error;
+  if (!greplace::parse_haar_cascade(xml, parsed, error)) {
+    std::cout << "greplace: " << xml_path << ": " << error << std::endl;
+    return false;
+  }
+  return true;
+}
+
+static const greplace::HaarCascadeData * read_cascade(const char * xml_path) {
+  std::string xml;
+  if (!read_file(xml_path, xml)) {
+    std::cout << "greplace: Could not open " << xml_path << std::endl;
+    return NULL;
+  }
+  unsigned long long hash = greplace::haar_cascade_hash(xml.data(),
+                                                        xml.size());
+  if (hash == greplace::frontal_face_cascade().xml_hash) {
+    return &greplace::frontal_face_cascade();
+  }
+
+  std::vector<std::string> paths = cache_paths(xml_path, hash, false);
+  for (size_t i = 0; i < paths.size(); i ++) {
+    const greplace::HaarCascadeData * data = map_cache(paths[i], hash);
+    if (data != NULL) {
+      return data;
+    }
+  }
+
+  greplace::ParsedCascade * parsed = new greplace::ParsedCascade;
+  if (!parse_file(xml_path, xml, *parsed)) {
+    delete parsed;
+    return NULL;
+  }
+  std::string written;
+  const greplace::HaarCascadeData * data = write_any_cache(xml_path, *parsed,
+                                                           hash, written);
+  if (data != NULL) {
+    delete parsed;
+    return data;
+  }
+  /* No cache to share; this process keeps its own copy */
+  std::cout << "greplace: Could not write a cache for " << xml_path;
+  std::cout << ", so it is parsed in every process. Run greplace ";
+  std::cout << "--cache_cascade " << xml_path << " where it can be written.";
+  std::cout << std::endl;
+  greplace::HaarCascadeData * own = new greplace::HaarCascadeData;
+  own->window_width = parsed->width;
+  own->window_height = parsed->height;
+  own->stage_count = static_cast<int>(parsed->stages.size());
+  own->stump_count = static_cast<int>(parsed->stumps.size());
+  own->stages = &parsed->stages[0];
+  own->stumps = &parsed->stumps[0];
+  own->xml_hash = hash;
+  return own;
+}
+
+bool greplace::write_cascade_cache(const char * xml_path) {
+  std::string xml;
+  if (!read_file(xml_path, xml)) {
+    std::cout << "greplace: Could not open " << xml_path << std::endl;
+    return false;
+  }
+  unsigned long long hash = greplace::haar_cascade_hash(xml.data(),
+                                                        xml.size());
+  if (hash == greplace::frontal_face_cascade().xml_hash) {
+    std::cout << "greplace: " << xml_path << " is built in and needs no ";
+    std::cout << "cache." << std::endl;
+    return true;
+  }
+  greplace::ParsedCascade parsed;
+  if (!parse_file(xml_path, xml, parsed)) {
+    return false;
+  }
+  std::string written;
+  const greplace::HaarCascadeData * data = write_any_cache(xml_path, parsed,
+                                                           hash, written);
+  if (data == NULL) {
+    std::cout << "greplace: Could not write a cache for " << xml_path;
+    std::cout << std::endl;
+    return false;
+  }
+  std::cout << "greplace: Wrote " << written << std::endl;
+  return true;
+}
+
+const greplace::HaarCascadeData * greplace::load_cascade(
+    const char * xml_path) {
+  static std::mutex mutex;
+  static std::map<std::string, const greplace::HaarCascadeData *> loaded;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::map<std::string, const greplace::HaarCascadeData *>::iterator found =
+      loaded.find(xml_path);
+  if (found != loaded.end()) {
+    return found->second;
+  }
+  const greplace::HaarCascadeData * cascade = read_cascade(xml_path);
+  if (cascade != NULL) {
+    loaded[xml_path] = cascade;
+  }
+  return cascade;
+}
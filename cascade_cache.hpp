@@ -0,0 +1,53 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_CASCADE_CACHE_HPP
+#define _GREPLACE_CASCADE_CACHE_HPP
+
+#include "haar_cascade.hpp"
+
+namespace greplace {
+  /*
+   * The tables of the cascade in XML_PATH, for the native detector. When
+   * the XML is the compiled in frontal face cascade those are used as they
+   * are. Otherwise they come from XML_PATH.cache, a binary copy mapped read
+   * only, so every process on the host shares one set of pages; it is
+   * written from the XML the first time, and again whenever the XML's hash
+   * no longer matches the one it records. Where the XML's directory cannot
+   * be written the cache goes under $XDG_CACHE_HOME/greplace (or
+   * ~/.cache/greplace), named by the hash, and failing that the process
+   * keeps its own parsed copy and says so. Returns NULL, with a message, if
+   * the XML cannot be used. Each path is loaded once per process, and the
+   * tables last until exit.
+   */
+  const greplace::HaarCascadeData * load_cascade(const char * xml_path);
+
+  /*
+   * Writes the cache load_cascade would look for, for installing a cascade
+   * ahead of time. Returns false, with a message, if none could be written.
+   */
+  bool write_cascade_cache(const char * xml_path);
+}
+
+#endif
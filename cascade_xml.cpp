@@ -0,0 +1,200 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <sstream>
+#include <string>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cascade_xml.hpp"
+
+static bool parse_float(const std::string & text, float & value,
+                        std::string & error) {
+  char * end;
+  double d = strtod(text.c_str(), &end);
+  if (end == text.c_str()) {
+    error = "expected a number, got '" + text + "'";
+    return false;
+  }
+  value = static_cast<float>(d);
+  return true;
+}
+
+/* A third rectangle cvSetImagesForHaarClassifierCascade would drop */
+static bool empty_rect(const greplace::HaarRect & r) {
+  return r.weight == 0.0f || r.width == 0 || r.height == 0;
+}
+
+static void finish_stage(greplace::ParsedCascade & cascade, float threshold) {
+  greplace::HaarStage stage;
+  stage.threshold = threshold;
+  stage.first = cascade.stages.empty() ? 0 :
+                cascade.stages.back().first + cascade.stages.back().count;
+  stage.count = static_cast<int>(cascade.stumps.size()) - stage.first;
+  stage.two_rects = true;
+  for (int i = stage.first; i < stage.first + stage.count; i ++) {
+    if (cascade.stumps[i].rect_count > 2) {
+      stage.two_rects = false;
+    }
+  }
+  cascade.stages.push_back(stage);
+}
+
+/*
+ * A tag at a time. The old format nests a stump as
+ * <_><feature><rects>..</rects><tilted/></feature><threshold/><left_val/>
+ * <right_val/></_>; anything with a left_node or right_node is a tree.
+ */
+bool greplace::parse_haar_cascade(const std::string & xml,
+                                  greplace::ParsedCascade & cascade,
+                                  std::string & error) {
+  cascade.width = cascade.height = 0;
+  cascade.stages.clear();
+  cascade.stumps.clear();
+  bool in_rects = false;
+  greplace::HaarStump stump;
+  memset(&stump, 0, sizeof(stump));
+  size_t pos = 0;
+  while ((pos = xml.find('<', pos)) != std::string::npos) {
+    if (xml.compare(pos, 4, "<!--") == 0) {
+      pos = xml.find("-->", pos);
+      if (pos == std::string::npos) {
+        error = "unterminated comment";
+        return false;
+      }
+      continue;
+    }
+    size_t close = xml.find('>', pos);
+    if (close == std::string::npos) {
+      error = "unterminated tag";
+      return false;
+    }
+    std::string tag = xml.substr(pos + 1, close - pos - 1);
+    size_t space = tag.find(' ');
+    if (space != std::string::npos) {
+      tag = tag.substr(0, space);
+    }
+    size_t next = xml.find('<', close);
+    std::string text = xml.substr(close + 1, next - close - 1);
+    pos = close + 1;
+
+    if (tag == "size" && cascade.width == 0) {
+      std::istringstream in(text);
+      in >> cascade.width >> cascade.height;
+      if (!in || cascade.width <= 2 || cascade.height <= 2) {
+        error = "bad window size '" + text + "'";
+        return false;
+      }
+    } else if (tag == "rects") {
+      if (cascade.width == 0) {
+        error = "a feature before the window size";
+        return false;
+      }
+      in_rects = true;
+      memset(&stump, 0, sizeof(stump));
+    } else if (tag == "/rects") {
+      in_rects = false;
+    } else if (tag == "_" && in_rects) {
+      if (stump.rect_count == 3) {
+        error = "more than three rectangles in a feature";
+        return false;
+      }
+      greplace::HaarRect & r = stump.rects[stump.rect_count];
+      std::istringstream in(text);
+      std::string weight;
+      in >> r.x >> r.y >> r.width >> r.height >> weight;
+      if (!in) {
+        error = "expected a rectangle, got '" + text + "'";
+        return false;
+      }
+      if (!parse_float(weight, r.weight, error)) {
+        return false;
+      }
+      if (!greplace::haar_rect_inside(r, cascade.width, cascade.height)) {
+        error = "a rectangle outside the window: '" + text + "'";
+        return false;
+      }
+      if (stump.rect_count < 2 || !empty_rect(r)) {
+        stump.rect_count++;
+      } else {
+        memset(&r, 0, sizeof(r));
+      }
+    } else if (tag == "tilted") {
+      if (atoi(text.c_str()) != 0) {
+        error = "tilted features are not supported";
+        return false;
+      }
+    } else if (tag == "left_node" || tag == "right_node") {
+      error = "only stump based cascades are supported";
+      return false;
+    } else if (tag == "threshold") {
+      if (!parse_float(text, stump.threshold, error)) {
+        return false;
+      }
+    } else if (tag == "left_val") {
+      if (!parse_float(text, stump.left, error)) {
+        return false;
+      }
+    } else if (tag == "right_val") {
+      if (!parse_float(text, stump.right, error)) {
+        return false;
+      }
+      if (stump.rect_count < 2) {
+        error = "a feature needs at least two rectangles";
+        return false;
+      }
+      cascade.stumps.push_back(stump);
+    } else if (tag == "stage_threshold") {
+      float threshold;
+      if (!parse_float(text, threshold, error)) {
+        return false;
+      }
+      finish_stage(cascade, threshold);
+    }
+  }
+  if (cascade.width == 0 || cascade.stages.empty()) {
+    error = "no cascade found";
+    return false;
+  }
+  return true;
+}
+
+bool greplace::haar_rect_inside(const greplace::HaarRect & r, int width,
+                                int height) {
+  /* Subtracted rather than added, so huge values cannot overflow */
+  return r.x >= 0 && r.y >= 0 && r.width >= 0 && r.height >= 0 &&
+         r.x <= width && r.y <= height &&
+         r.width <= width - r.x && r.height <= height - r.y;
+}
+
+unsigned long long greplace::haar_cascade_hash(const char * data,
+                                               size_t length) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i ++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
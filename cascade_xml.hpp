@@ -0,0 +1,61 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_CASCADE_XML_HPP
+#define _GREPLACE_CASCADE_XML_HPP
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+
+#include "haar_cascade.hpp"
+
+namespace greplace {
+  /* A cascade read from XML, owning its tables */
+  struct ParsedCascade {
+    int width, height;
+    std::vector<greplace::HaarStage> stages;
+    std::vector<greplace::HaarStump> stumps;
+  };
+
+  /*
+   * Reads an old style (stump based, untilted) OpenCV Haar cascade, storing
+   * values as float the way cvLoad does. Returns false with ERROR set for
+   * anything else.
+   */
+  bool parse_haar_cascade(const std::string & xml, ParsedCascade & cascade,
+                          std::string & error);
+
+  /*
+   * Whether R lies wholly inside a WIDTH x HEIGHT base window, so the
+   * detector's corner offsets stay inside every window it scans.
+   */
+  bool haar_rect_inside(const greplace::HaarRect & r, int width, int height);
+
+  /* 64 bit FNV-1a over the XML text; names a cascade in caches */
+  unsigned long long haar_cascade_hash(const char * data, size_t length);
+}
+
+#endif
@@ -34,18 +34,25 @@
 #include <sstream>
 #include <string>
 #include <exception>
+#include <algorithm>
+#include <functional>
+#include <vector>
 
 #include <time.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include "cpu.hpp"
+#include "allocation.hpp"
+#include "alpha_mask.hpp"
+#include "kernels.hpp"
+#include "pixel_expr.hpp"
+#include "parallel.hpp"
+#include "tracker.hpp"
+#include "sink.hpp"
+#include "display.hpp"
 
-cv::CascadeClassifier greplace::init(const char * CLASSIFIER_CONFIG) {
-  cv::CascadeClassifier cascade_classifier(CLASSIFIER_CONFIG);
-  return cascade_classifier;
-}
-
-cv::Rect greplace::get_largest_rect(cv::Vector<cv::Rect> rects) {
+cv::Rect greplace::get_largest_rect(const std::vector<cv::Rect> & rects) {
 	cv::Rect largest_rect = rects[0];
 	for (size_t i = 1; i < rects.size(); i ++) {
 		if (rects[i].area() > largest_rect.area()) {
@@ -62,66 +69,30 @@ double greplace::dist(int x, int y, int rows, int columns) {
                       static_cast<double>(columns) / 2), 2));
 }
 
-void perform_circular_alpha_filter(cv::Mat &input, double r0, double rf) {
-	double max_dist = greplace::dist(0, 0, input.rows, input.cols);
-  double mf = 255 / (rf - r0);
-	for (int row = 0; row < input.rows; row ++ ) {
-		uchar *p = input.ptr(row);
-		for (int col = 0; col < input.cols; col ++) {
-			int offset = 4*(col-1);
-			if (offset < 0) {
-				offset = 0;
-			}
-			double ratio = greplace::dist(row, col, input.rows, input.cols) / max_dist;
-			int alpha = 255;
-      if (ratio >= r0) {
-        alpha = 255 - mf*(ratio - r0);
-      }
-      if (ratio >= rf) {
-        alpha = 0;
-      }
-			p[offset + 3] = alpha;
-		}
-	}
-}
-
-void perform_reverse_circular_alpha_filter(cv::Mat &input, double r0, double rf) {
-	double max_dist = greplace::dist(0, 0, input.rows, input.cols);
-  double mf = 255 / (rf - r0);
-	for (int row = 0; row < input.rows; row ++ ) {
-		uchar *p = input.ptr(row);
-		for (int col = 0; col < input.cols; col ++) {
-			int offset = 4*(col-1);
-			if (offset < 0) {
-				offset = 0;
-			}
-			double ratio = greplace::dist(row, col, input.rows, input.cols) / max_dist;
-			int alpha = 0;
-      if (ratio >= r0) {
-        alpha = mf*(ratio - r0);
-      }
-      if (ratio >= rf) {
-        alpha = 255;
-      }
-			p[offset + 3] = alpha;
-		}
-	}
-}
-
-void alpha_compose(const cv::Mat& rgba1, const cv::Mat& rgba2,
-                             cv::Mat& rgba_dest) {
-	cv::Mat a1(rgba1.size(), rgba1.type()), ra1;
-	cv::Mat a2(rgba2.size(), rgba2.type());
-	int mixch[]={3, 0, 3, 1, 3, 2, 3, 3};
-	mixChannels(&rgba1, 1, &a1, 1, mixch, 4);
-	mixChannels(&rgba2, 1, &a2, 1, mixch, 4);
-	subtract(cv::Scalar::all(255), a1, ra1);
-	bitwise_or(a1, cv::Scalar(0,0,0,255), a1);
-	bitwise_or(a2, cv::Scalar(0,0,0,255), a2);
-	multiply(a2, ra1, a2, 1./255);
-	multiply(a1, rgba1, a1, 1./255);
-	multiply(a2, rgba2, a2, 1./255);
-	add(a1, a2, rgba_dest);
+/*
+ * Blends SRC over DST into OUT as the circular alpha filters always have:
+ * each pixel takes its alpha from the mask one column to its right, and
+ * the last column, which the filters never touched, is SRC alone.
+ */
+template <class Tap>
+static void masked_blend(const cv::Mat & src, const cv::Mat & mask,
+                         const cv::Mat & dst, const cv::Mat & dst_mask,
+                         cv::Mat out, Tap tap) {
+  using namespace greplace::expr;
+  if (src.cols < 2) {
+    evaluate(Plane(src), out, tap);
+    return;
+  }
+  cv::Mat body = out(cv::Rect(0, 0, src.cols - 1, src.rows));
+  if (dst_mask.empty()) {
+    evaluate(lerp(Plane(src), Plane(mask, 1), Plane(dst), Opaque()), body,
+             tap);
+  } else {
+    evaluate(lerp(Plane(src), Plane(mask, 1), Plane(dst), Plane(dst_mask, 1)),
+             body, tap);
+  }
+  cv::Mat last_column = out(cv::Rect(src.cols - 1, 0, 1, src.rows));
+  evaluate(Plane(src, src.cols - 1), last_column, tap);
 }
 
 cv::Rect greplace::intersection(cv::Rect r1, cv::Rect r2) {
@@ -145,23 +116,78 @@ cv::Rect greplace::intersection(cv::Rect r1, cv::Rect r2) {
   return intersection; 
 }
 
-cv::Rect find_possible_face(cv::Mat image,
-                            cv::CascadeClassifier haar_cascade,
-                            int threshold) {
+cv::Rect greplace::find_possible_face(greplace::FrameContext & frame,
+                                      greplace::Detector & detector,
+                                      int threshold, int scale) {
+  return find_planned_face(frame, detector, threshold,
+                           greplace::full_frame_plan(frame.size(),
+                                                     threshold, scale));
+}
+
+cv::Rect greplace::find_planned_face(greplace::FrameContext & frame,
+                                     greplace::Detector & detector,
+                                     int threshold,
+                                     const greplace::DetectionPlan & plan) {
+  std::vector<cv::Rect> faces;
+  find_planned_faces(frame, detector, threshold, plan, 1, faces);
+  if (faces.empty()) {
+    return cv::Rect(0, 0, 0, 0);
+  }
+  return faces[0];
+}
+
+void greplace::find_possible_faces(greplace::FrameContext & frame,
+                                   greplace::Detector & detector,
+                                   int threshold, int max_faces, int scale,
+                                   std::vector<cv::Rect> & faces) {
+  find_planned_faces(frame, detector, threshold,
+                     greplace::full_frame_plan(frame.size(), threshold,
+                                               scale),
+                     max_faces, faces);
+}
+
+static bool larger(const cv::Rect & a, const cv::Rect & b) {
+  return a.area() > b.area();
+}
+
+void greplace::find_planned_faces(greplace::FrameContext & frame,
+                                  greplace::Detector & detector,
+                                  int threshold,
+                                  const greplace::DetectionPlan & plan,
+                                  int max_faces,
+                                  std::vector<cv::Rect> & faces) {
   std::vector<cv::Rect> possibles;
-  cv::Mat greyscale;
-  cv::Rect ret;
-  cvtColor(image, greyscale, CV_BGR2GRAY);
-  haar_cascade.detectMultiScale(greyscale, possibles);
-  if (possibles.size() == 0) {
-    ret = cv::Rect(0, 0, 0, 0);
-  } else {
-    ret = greplace::get_largest_rect(possibles);
-    if (ret.area() < threshold) {
-      ret = cv::Rect(0, 0, 0, 0);
+  int s = plan.scale;
+  const cv::Mat & image = frame.detection_grey(s);
+  /* Rounded outwards, so the smaller image covers at least the plan */
+  cv::Rect region(plan.region.x / s, plan.region.y / s,
+                  (plan.region.br().x + s - 1) / s - plan.region.x / s,
+                  (plan.region.br().y + s - 1) / s - plan.region.y / s);
+  region &= cv::Rect(0, 0, image.cols, image.rows);
+  cv::Size min_size(plan.min_size.width / s, plan.min_size.height / s);
+  cv::Size max_size((plan.max_size.width + s - 1) / s,
+                    (plan.max_size.height + s - 1) / s);
+  detector.detect(image(region), possibles, min_size, max_size);
+  /* Stable, so equal faces keep the order get_largest_rect would pick in */
+  std::stable_sort(possibles.begin(), possibles.end(), larger);
+  faces.clear();
+  for (size_t i = 0; i < possibles.size() &&
+                     faces.size() < static_cast<size_t>(max_faces); i ++) {
+    cv::Rect face((region.x + possibles[i].x) * s,
+                  (region.y + possibles[i].y) * s,
+                  possibles[i].width * s, possibles[i].height * s);
+    /* Grouping can leave a face a little under the minimum size */
+    if (face.area() < threshold) {
+      break;
+    }
+    bool overlaps = false;
+    for (size_t j = 0; j < faces.size() && !overlaps; j ++) {
+      overlaps = (face & faces[j]).area() != 0;
+    }
+    if (!overlaps) {
+      faces.push_back(face);
     }
   }
-  return ret;
 }
 
 bool greplace::rects_overlap(cv::Rect r1, cv::Rect r2) {
@@ -185,7 +211,7 @@ cv::Mat greplace::to_grayscale(cv::Mat image) {
 }
 
 cv::Mat greplace::get_new_training_face(cv::Mat image, cv::Rect face,
-                                        greplace::Person person) {
+                                        const greplace::Person & person) {
 	cv::Mat new_training = to_grayscale(image(face));
   cv::Mat f = person.face();
 	cv::Mat new_training_resized = f.clone();
@@ -193,40 +219,105 @@ cv::Mat greplace::get_new_training_face(cv::Mat image, cv::Rect face,
   return new_training_resized;
 }
 
+cv::Mat greplace::get_new_training_face(greplace::FrameContext & frame,
+                                        cv::Rect face,
+                                        const greplace::Person & person) {
+  return frame.face(face, person.face().size());
+}
 
-cv::Mat update_image(cv::Rect face, cv::Mat replacement_face,
-                     cv::Mat greyscale, double r0, double rf) {
-	cv::Rect faceInner(face.x + face.width * 1/10,
-				                    face.y + face.height * 1/10, 
-								            face.width * 4/5, face.height * 4/5);
-  cv::Mat scaled_replacement_face;
-  resize(replacement_face, scaled_replacement_face, face.size());
-	cv::Rect replacementInner (scaled_replacement_face.cols / 10,
-                                  scaled_replacement_face.rows / 10,
-				                          scaled_replacement_face.cols * 4 / 5,
-                                  scaled_replacement_face.rows * 4 / 5);
-  cv::Mat replacementInnerMat = scaled_replacement_face(replacementInner);
-	cv::Mat scaledReplacementFacebgra, destROIbgra, alphaBlended;
-	cv::Mat destROI = greyscale(faceInner);
-	cvtColor(destROI, destROIbgra, CV_GRAY2BGRA);
-	cvtColor(replacementInnerMat, scaledReplacementFacebgra, CV_GRAY2BGRA);
-	perform_circular_alpha_filter(scaledReplacementFacebgra, r0, rf);
-	alpha_compose(scaledReplacementFacebgra, destROIbgra, alphaBlended);
-	cvtColor(alphaBlended, destROI, CV_RGBA2GRAY);
-  return greyscale;
+
+/* The part of a detected face that the replacement is drawn over */
+static cv::Rect inner_face(cv::Rect face) {
+  return cv::Rect(face.x + face.width * 1/10, face.y + face.height * 1/10,
+                  face.width * 4/5, face.height * 4/5);
 }
 
+/*
+ * Looks up each of REPLACEMENTS prepared for its face and records in
+ * BUFFERS.placements where it is drawn: centred on the inner face and
+ * clipped to a frame of FRAME_SIZE, with the texture and mask cropped to
+ * match. Faces without a replacement, or off the frame, are left out. The
+ * texture cache is not thread safe, so this comes before any drawing is
+ * shared out.
+ */
+static void place_replacements(
+    const std::vector<cv::Rect> & faces,
+    const std::vector<greplace::Replacement> & replacements,
+    cv::Size frame_size, double r0, double rf,
+    greplace::ComposeBuffers & buffers) {
+  buffers.placements.clear();
+  for (size_t i = 0; i < faces.size(); i ++) {
+    if (replacements[i].empty()) {
+      continue;
+    }
+    const greplace::ReplacementTexture & prepared =
+        buffers.textures.texture(replacements[i], faces[i].size(), r0, rf);
+    cv::Rect inner = inner_face(faces[i]);
+    /* The texture is up to half a quantum off the face size each way */
+    cv::Rect placed(inner.x + (inner.width - prepared.texture.cols) / 2,
+                    inner.y + (inner.height - prepared.texture.rows) / 2,
+                    prepared.texture.cols, prepared.texture.rows);
+    cv::Rect visible = placed & cv::Rect(0, 0, frame_size.width,
+                                         frame_size.height);
+    if (visible.area() == 0) {
+      continue;
+    }
+    cv::Rect crop(visible.x - placed.x, visible.y - placed.y, visible.width,
+                  visible.height);
+    greplace::Placement placement;
+    placement.face = faces[i];
+    placement.region = visible;
+    /* Views, which outlive the texture's place in the cache */
+    placement.texture = prepared.texture(crop);
+    placement.mask = prepared.mask(crop);
+    buffers.placements.push_back(placement);
+  }
+}
+
+/*
+ * Blends each of PLACEMENTS straight into GREYSCALE. The faces do not
+ * overlap, so with POOL they are drawn a face per worker.
+ */
+static void draw_replacements(
+    cv::Mat & greyscale, const std::vector<greplace::Placement> & placements,
+    greplace::WorkerPool * pool) {
+  std::function<void(int, int)> draw = [&](int i, int worker) {
+    cv::Mat destROI = greyscale(placements[i].region);
+    masked_blend(placements[i].texture, placements[i].mask, destROI,
+                 cv::Mat(), destROI, greplace::expr::NoTap());
+  };
+  int count = static_cast<int>(placements.size());
+  if (pool != NULL && count > 1) {
+    pool->run(count, draw);
+    return;
+  }
+  for (int i = 0; i < count; i ++) {
+    draw(i, 0);
+  }
+}
+
+volatile sig_atomic_t greplace::exit_requested = 0;
+
 void greplace::exit_handler(int signo) {
-	std::cout << std::endl << "greplace: User entered kill signal" << std::endl;
-	exit(EXIT_SUCCESS);
+  /* Let the main loop close its outputs; a second signal exits at once */
+  if (greplace::exit_requested) {
+    _exit(EXIT_SUCCESS);
+  }
+  greplace::exit_requested = 1;
 }
 
-cv::Mat greplace::find_face(cv::Mat image,
-                            cv::CascadeClassifier classifier,
+void greplace::report_throughput(int frames, double start_ticks) {
+  double totalT = (static_cast<double>(cv::getTickCount()) - start_ticks) /
+                  cv::getTickFrequency();
+  std::cout << "greplace: " << frames << " frames in " << totalT << " s, ";
+  std::cout << frames / totalT << " fps" << std::endl;
+}
+
+cv::Mat greplace::find_face(cv::Mat image, greplace::Detector & detector,
                             int THRESHOLDING_FACTOR) {
   std::vector<cv::Rect> possibles;
   cv::Rect ret;
-  classifier.detectMultiScale(image, possibles);
+  detector.detect(image, possibles);
   if (possibles.size() == 0) {
     throw 0;
   } else {
@@ -239,63 +330,427 @@ cv::Mat greplace::find_face(cv::Mat image,
 }
 
 cv::Mat greplace::blend(cv::Mat face1, cv::Mat face2, double r0, double rf) {
-  cv::Mat face1bgra, face2bgra, blended, final;
-	cvtColor(face1, face1bgra, CV_GRAY2BGRA);
-	cvtColor(face2, face2bgra, CV_GRAY2BGRA);
-	perform_circular_alpha_filter(face1bgra, r0, rf);
-  perform_reverse_circular_alpha_filter(face2bgra, r0, rf);
-	alpha_compose(face1bgra, face2bgra, blended);
-	cvtColor(blended, final, CV_RGBA2GRAY);
+  greplace::ComposeBuffers buffers;
+  return blend(face1, face2, r0, rf, buffers);
+}
+
+template <class Tap>
+static cv::Mat blend_faces(cv::Mat face1, cv::Mat face2, double r0, double rf,
+                           greplace::ComposeBuffers & buffers, Tap tap) {
+  cv::Mat final = greplace::scratch(buffers.blended_grey, face1.size(),
+                                    CV_8UC1);
+  cv::Mat mask = buffers.masks.mask(face1.size(), r0, rf, false,
+                                    buffers.alpha_mask);
+  cv::Mat reverse_mask = buffers.masks.mask(face2.size(), r0, rf, true,
+                                            buffers.reverse_alpha_mask);
+  masked_blend(face1, mask, face2, reverse_mask, final, tap);
+  return final;
+}
+
+cv::Mat greplace::blend(cv::Mat face1, cv::Mat face2, double r0, double rf,
+                        greplace::ComposeBuffers & buffers) {
+  return blend_faces(face1, face2, r0, rf, buffers, greplace::expr::NoTap());
+}
+
+cv::Mat greplace::blend(cv::Mat face1, cv::Mat face2, double r0, double rf,
+                        greplace::ComposeBuffers & buffers,
+                        cv::Mat & histogram) {
+  unsigned int bins[256] = {0};
+  cv::Mat final = blend_faces(face1, face2, r0, rf, buffers,
+                              greplace::expr::HistogramTap(bins));
+  histogram.create(256, 1, CV_32FC1);
+  for (int i = 0; i < 256; i ++) {
+    histogram.at<float>(i) = static_cast<float>(bins[i]);
+  }
   return final;
 }
 
-void greplace::main_loop(cv::VideoCapture & capture,
-                         cv::CascadeClassifier cascade_classifier,
+/* Enough for the blend masks of a few face sizes */
+static const size_t ALPHA_MASK_CACHE_SIZE = 16;
+/* Enough for the faces a gallery's predictions flicker between */
+static const size_t REPLACEMENT_CACHE_SIZE = 16;
+
+greplace::ComposeBuffers::ComposeBuffers(void)
+  : masks(ALPHA_MASK_CACHE_SIZE), textures(REPLACEMENT_CACHE_SIZE) {
+  greplace::count_allocations(blended_grey);
+  greplace::count_allocations(alpha_mask);
+  greplace::count_allocations(reverse_alpha_mask);
+  greplace::count_allocations(feathered);
+  greplace::count_allocations(luma);
+  greplace::count_allocations(flat_chroma);
+  greplace::count_allocations(ycrcb);
+}
+
+void greplace::ComposeBuffers::reserve(cv::Size frame) {
+  greplace::scratch(blended_grey, frame, CV_8UC1);
+  greplace::scratch(alpha_mask, frame, CV_8UC1);
+  greplace::scratch(reverse_alpha_mask, frame, CV_8UC1);
+  greplace::scratch(feathered, frame, CV_8UC1);
+  greplace::scratch(luma, frame, CV_8UC1);
+  greplace::scratch(flat_chroma, frame, CV_8UC1);
+  greplace::scratch(ycrcb, frame, CV_8UC3);
+}
+
+greplace::FrameState::FrameState(const greplace::Person & previous)
+  : previous(previous), timeSinceLastUser(0) { }
+
+void greplace::recognise(greplace::FrameState & state,
+                         greplace::FrameContext & frame,
+                         const std::vector<cv::Rect> & faces,
                          cv::Ptr<cv::FaceRecognizer> model,
-                         greplace::Person previous,
-                         const int THRESHOLD,
                          const int INTERPERSON_PERIOD,
-                         const char * MAIN_WINDOW_TITLE) {
-  cv::Mat image, greyscale, final_image;
-  cv::Rect previous_face, face;
-  greplace::Person current;
-  int timeSinceLastUser = 0, frmCnt = 0;
-  double totalT;
-  signal(SIGINT, greplace::exit_handler);
-  capture.grab();
-  while (cv::waitKey(2) < 0) {
-    capture >> image;
-    double t = static_cast<double>(cv::getTickCount());
-    greyscale = to_grayscale(image);
-    previous_face = face;
-    face = find_possible_face(image, cascade_classifier, THRESHOLD);
-    if (face.area() != 0 && rects_overlap(face, previous_face)) {
-      /* We've detected a face */
-      /* Check if new person */
-		  if (timeSinceLastUser > INTERPERSON_PERIOD) {
-        previous = current;
-        current.clear();
-        previous.train_model(model);
-		  }
-      /* Get the replacement face */
-      cv::Mat replacement = previous.prediction(image, face, model);
-      greyscale = update_image(face, replacement, greyscale, 0.7, 0.9);
-      timeSinceLastUser = 0;
-    }   
-    if (face.area() != 0) {
-      /* Add the detected face to the training list */
-      cv::Mat new_training = get_new_training_face(image, face, previous);
-      current.update(new_training);
+                         std::vector<greplace::Replacement> & replacements) {
+  state.previous_faces.swap(state.faces);
+  state.faces.assign(faces.begin(), faces.end());
+  replacements.assign(faces.size(), greplace::Replacement());
+  state.steady.clear();
+  for (size_t i = 0; i < faces.size(); i ++) {
+    for (size_t j = 0; j < state.previous_faces.size(); j ++) {
+      if (rects_overlap(faces[i], state.previous_faces[j])) {
+        state.steady.push_back(faces[i]);
+        break;
+      }
+    }
+  }
+  if (!state.steady.empty()) {
+    /* We've detected a face */
+    /* Check if new person */
+    if (state.timeSinceLastUser > INTERPERSON_PERIOD) {
+      state.previous = state.current;
+      state.current.clear();
+      state.previous.train_model(model);
     }
+    /* Get the replacement faces */
+    state.previous.predict(frame, state.steady, model, state.prediction,
+                           state.predicted);
+    size_t k = 0;
+    for (size_t i = 0; i < faces.size() && k < state.steady.size(); i ++) {
+      if (faces[i] != state.steady[k]) {
+        continue;
+      }
+      replacements[i].index = state.predicted[k++];
+      replacements[i].face = state.previous.face(replacements[i].index);
+      replacements[i].gallery = state.previous.gallery();
+    }
+    state.timeSinceLastUser = 0;
+  }
+  if (!faces.empty()) {
+    /* Add the detected face to the training list */
+    cv::Mat new_training = get_new_training_face(frame, faces[0],
+                                                 state.previous);
+    state.current.update(new_training);
+  }
+  state.timeSinceLastUser += 50;
+}
+
+/* Pixels either side of the seam that SMOOTH_SEAM blurs */
+static const int FEATHER_WIDTH = 8;
+
+/* Copies the band of SOURCE that lies inside OUTER but not INNER into DEST */
+static void copy_band(const cv::Mat & source, cv::Rect outer, cv::Rect inner,
+                      cv::Mat & dest) {
+  if (inner.area() == 0) {
+    cv::Mat d = dest(outer);
+    source(outer).copyTo(d);
+    return;
+  }
+  cv::Rect strips[] = {
+    cv::Rect(outer.x, outer.y, outer.width, inner.y - outer.y),
+    cv::Rect(outer.x, inner.br().y, outer.width, outer.br().y - inner.br().y),
+    cv::Rect(outer.x, inner.y, inner.x - outer.x, inner.height),
+    cv::Rect(inner.br().x, inner.y, outer.br().x - inner.br().x, inner.height)
+  };
+  for (size_t i = 0; i < sizeof(strips) / sizeof(strips[0]); i ++) {
+    if (strips[i].area() > 0) {
+      cv::Mat d = dest(strips[i]);
+      source(strips[i]).copyTo(d);
+    }
+  }
+}
 
+/* Blurs GREY into OUT along the edge of SEAM only */
+static void feather_seam(const cv::Mat & grey, cv::Rect seam, cv::Mat & out,
+                         greplace::ComposeBuffers & buffers) {
+  cv::Rect frame(0, 0, grey.cols, grey.rows);
+  cv::Rect outer(seam.x - FEATHER_WIDTH, seam.y - FEATHER_WIDTH,
+                 seam.width + 2 * FEATHER_WIDTH,
+                 seam.height + 2 * FEATHER_WIDTH);
+  outer &= frame;
+  cv::Rect inner(seam.x + FEATHER_WIDTH, seam.y + FEATHER_WIDTH,
+                 seam.width - 2 * FEATHER_WIDTH,
+                 seam.height - 2 * FEATHER_WIDTH);
+  if (inner.width <= 0 || inner.height <= 0) {
+    inner = cv::Rect();
+  }
+  /* A ROI blur reads the pixels around it, so the band matches a full blur */
+  cv::Mat band = greplace::scratch(buffers.feathered, frame.size(), CV_8UC1);
+  cv::Mat blurred = band(outer);
+  cv::GaussianBlur(grey(outer), blurred, cv::Size(9, 9), 0, 0);
+  copy_band(band, outer, inner, out);
+}
+
+/* Rows the 9x9 blur reads above and below each row it writes */
+static const int BLUR_HALO = 4;
+/* Assumed when the system does not say how large its L2 cache is */
+static const long DEFAULT_L2_CACHE_SIZE = 256 * 1024;
+/* Fewer rows than this and the halo costs more than the tile saves */
+static const int MIN_TILE_ROWS = 16;
+
+/*
+ * Rows per tile for frames COLS wide. A tile's colour rows, its grey rows
+ * and the blurred rows it writes, five bytes a column in all, take up half
+ * of L2, leaving the rest for the face and the other tiles' stragglers.
+ */
+static int tile_rows(int cols) {
+  long cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if (cache <= 0) {
+    cache = DEFAULT_L2_CACHE_SIZE;
+  }
+  int rows = static_cast<int>(cache / 2 / (5 * cols)) - 2 * BLUR_HALO;
+  return std::max(rows, MIN_TILE_ROWS);
+}
+
+/*
+ * SMOOTH_FRAME one band of rows at a time: each tile is converted to grey,
+ * has its share of the faces drawn in and is blurred while it is still in
+ * cache, instead of each of those steps passing over the whole frame. The
+ * tiles overlap by the blur's reach, so the result matches the untiled one.
+ */
+static cv::Mat compose_tiles(greplace::FrameContext & frame,
+                             greplace::ComposeBuffers & buffers,
+                             greplace::WorkerPool & pool,
+                             cv::Mat final_image) {
+  const cv::Mat & bgr = frame.image();
+  cv::Size size = frame.size();
+  final_image.create(size, CV_8UC1);
+  const std::vector<greplace::Placement> & placements = buffers.placements;
+  /* The detector may have converted the frame already */
+  cv::Mat grey;
+  if (frame.has_grey()) {
+    grey = frame.grey();
+  }
+  while (buffers.tiles.size() < static_cast<size_t>(pool.size())) {
+    buffers.tiles.push_back(cv::Mat());
+    greplace::count_allocations(buffers.tiles.back());
+  }
+  int rows = tile_rows(size.width);
+  int tiles = (size.height + rows - 1) / rows;
+  pool.run(tiles, [&](int tile, int worker) {
+    int top = tile * rows;
+    int bottom = std::min(top + rows, size.height);
+    int halo_top = std::max(top - BLUR_HALO, 0);
+    cv::Rect halo(0, halo_top, size.width,
+                  std::min(bottom + BLUR_HALO, size.height) - halo_top);
+    cv::Mat storage = greplace::scratch(buffers.tiles[worker],
+                                        cv::Size(size.width,
+                                                 rows + 2 * BLUR_HALO),
+                                        CV_8UC1);
+    /* Not a ROI, so the blur takes the tile's edges as the frame's */
+    cv::Mat grey_tile(halo.height, halo.width, CV_8UC1, storage.data,
+                      storage.step);
+    if (grey.empty()) {
+      cvtColor(bgr(halo), grey_tile, CV_BGR2GRAY);
+    } else {
+      grey(halo).copyTo(grey_tile);
+    }
+    for (size_t i = 0; i < placements.size(); i ++) {
+      const greplace::Placement & placed = placements[i];
+      cv::Rect band = placed.region & halo;
+      if (band.area() == 0) {
+        continue;
+      }
+      cv::Rect from(band.x - placed.region.x, band.y - placed.region.y,
+                    band.width, band.height);
+      cv::Mat dest = grey_tile(cv::Rect(band.x, band.y - halo.y, band.width,
+                                        band.height));
+      masked_blend(placed.texture(from), placed.mask(from), dest, cv::Mat(),
+                   dest, greplace::expr::NoTap());
+    }
+    cv::Mat written = final_image(cv::Rect(0, top, size.width, bottom - top));
+    cv::GaussianBlur(grey_tile(cv::Rect(0, top - halo.y, size.width,
+                                        bottom - top)),
+                     written, cv::Size(9, 9), 0, 0);
+  });
+  return final_image;
+}
+
+/* compose, up to the point where colour output would add the chroma */
+static cv::Mat compose_luma(greplace::FrameContext & frame,
+                            const greplace::Options & options,
+                            greplace::ComposeBuffers & buffers,
+                            cv::Mat final_image) {
+  greplace::Smoothing smoothing = options.smoothing;
+  if (options.tiles != NULL && smoothing == greplace::SMOOTH_FRAME) {
+    return compose_tiles(frame, buffers, *options.tiles, final_image);
+  }
+  /* A mapped capture is only copied when there is something to draw */
+  cv::Mat & greyscale = buffers.placements.empty() ? frame.grey() :
+                                                     frame.drawable_grey();
+  draw_replacements(greyscale, buffers.placements, options.tiles);
+  if (smoothing == greplace::SMOOTH_FRAME) {
     cv::GaussianBlur(greyscale, final_image, cv::Size(9, 9), 0, 0);
-    cv::imshow(MAIN_WINDOW_TITLE, final_image);
-    timeSinceLastUser += 50;
-    t = (static_cast<double>(cv::getTickCount())-t)/cv::getTickFrequency();
-    totalT += t;
+    return final_image;
+  }
+  cv::Mat out = greyscale;
+  if (smoothing == greplace::SMOOTH_SEAM_BOX) {
+    cv::blur(greyscale, final_image, cv::Size(3, 3));
+    out = final_image;
+  }
+  /* The bands can meet, and share the feathering buffer, so one at a time */
+  for (size_t i = 0; i < buffers.placements.size(); i ++) {
+    feather_seam(greyscale, inner_face(buffers.placements[i].face), out,
+                 buffers);
+  }
+  return out;
+}
+
+/*
+ * Fades PLANE towards its mean inside REGION under MASK, so the chroma of
+ * the face underneath does not show through the replacement.
+ */
+static void flatten_chroma(cv::Mat & plane, cv::Rect region,
+                           const cv::Mat & mask,
+                           greplace::ComposeBuffers & buffers) {
+  cv::Mat dest = plane(region);
+  cv::Mat flat = greplace::scratch(buffers.flat_chroma, region.size(),
+                                   CV_8UC1);
+  flat.setTo(cv::mean(dest));
+  masked_blend(flat, mask, dest, cv::Mat(), dest, greplace::expr::NoTap());
+}
+
+/*
+ * Puts the chroma of FRAME back under LUMA and converts to BGR, unless
+ * YCRCB_OUTPUT asks for the frame as it is.
+ */
+static cv::Mat colourise(greplace::FrameContext & frame, const cv::Mat & luma,
+                         bool ycrcb_output,
+                         greplace::ComposeBuffers & buffers,
+                         cv::Mat final_image) {
+  cv::Mat & cr = frame.chroma_red();
+  cv::Mat & cb = frame.chroma_blue();
+  for (size_t i = 0; i < buffers.placements.size(); i ++) {
+    const greplace::Placement & placed = buffers.placements[i];
+    flatten_chroma(cr, placed.region, placed.mask, buffers);
+    flatten_chroma(cb, placed.region, placed.mask, buffers);
+  }
+  const cv::Mat planes[] = { luma, cr, cb };
+  const int from_to[] = { 0, 0, 1, 1, 2, 2 };
+  if (ycrcb_output) {
+    final_image.create(luma.size(), CV_8UC3);
+    cv::mixChannels(planes, 3, &final_image, 1, from_to, 3);
+    return final_image;
+  }
+  cv::Mat ycrcb = greplace::scratch(buffers.ycrcb, luma.size(), CV_8UC3);
+  cv::mixChannels(planes, 3, &ycrcb, 1, from_to, 3);
+  cvtColor(ycrcb, final_image, CV_YCrCb2BGR);
+  return final_image;
+}
+
+cv::Mat greplace::compose(greplace::FrameContext & frame,
+                          const std::vector<cv::Rect> & faces,
+                          const std::vector<greplace::Replacement> & replacements,
+                          const greplace::Options & options,
+                          greplace::ComposeBuffers & buffers,
+                          cv::Mat final_image) {
+  place_replacements(faces, replacements, frame.size(), 0.7, 0.9, buffers);
+  if (!options.colour) {
+    return compose_luma(frame, options, buffers, final_image);
+  }
+  /* Converts to YCrCb before any tiles look for the grey plane */
+  frame.chroma_red();
+  cv::Mat luma = compose_luma(frame, options, buffers,
+                              greplace::scratch(buffers.luma,
+                                                frame.size(),
+                                                CV_8UC1));
+  return colourise(frame, luma, options.ycrcb_output, buffers, final_image);
+}
+
+/* Frames that may allocate before --check_allocations expects none */
+static const int ALLOCATION_WARMUP_FRAMES = 2;
+
+/*
+ * Aborts on an allocation after warm-up, apart from the EXEMPT face samples
+ * the frame added to its pool while the galleries fill
+ */
+static void check_allocations(int frame, size_t allocations, size_t bytes,
+                              size_t exempt) {
+  greplace::CountingAllocator & allocator = greplace::counting_allocator();
+  if (allocator.allocations() - allocations <= exempt) {
+    return;
+  }
+  std::cout << "greplace: frame " << frame << " allocated ";
+  std::cout << allocator.allocations() - allocations << " buffers, ";
+  std::cout << allocator.bytes() - bytes << " bytes" << std::endl;
+  if (frame >= ALLOCATION_WARMUP_FRAMES) {
+    std::cout << "greplace: Allocation after warm-up." << std::endl;
+    abort();
+  }
+}
+
+bool greplace::main_loop(greplace::Capture & capture,
+                         greplace::Detector & detector,
+                         cv::Ptr<cv::FaceRecognizer> model,
+                         const greplace::Person & previous,
+                         const greplace::Options & options) {
+  cv::Mat final_image;
+  std::vector<cv::Rect> faces;
+  std::vector<greplace::Replacement> replacements;
+  greplace::FrameState state(previous);
+  greplace::FrameContext frame;
+  greplace::ComposeBuffers buffers;
+  greplace::FaceTracker tracker(options.detect_period,
+                                options.track_confidence,
+                                options.full_scan_period,
+                                options.detect_scale,
+                                options.motion_threshold,
+                                options.idle_after, options.idle_period,
+                                options.max_faces);
+  greplace::CountingAllocator & allocator = greplace::counting_allocator();
+  greplace::count_allocations(final_image);
+  int frmCnt = 0;
+  double totalT = 0.0;
+  double start = static_cast<double>(cv::getTickCount());
+  signal(SIGINT, greplace::exit_handler);
+  while (options.display == NULL || !options.display->key_pressed()) {
+    if (!capture.read(frame) || greplace::exit_requested) {
+      /* End of the input */
+      greplace::report_throughput(frmCnt, start);
+      if (options.detect_period > 1 || options.motion_threshold > 0) {
+        tracker.report();
+      }
+      if (options.check_allocations) {
+        std::cout << "greplace: " << allocator.allocations() << " images, ";
+        std::cout << allocator.bytes() << " bytes allocated" << std::endl;
+      }
+      return true;
+    }
+    double t = static_cast<double>(cv::getTickCount());
+    size_t allocations = allocator.allocations(), bytes = allocator.bytes();
+    size_t face_buffers = frame.face_buffers();
+    if (frmCnt == 0) {
+      buffers.reserve(frame.size());
+      state.previous.reserve(state.prediction, options.max_faces);
+    }
+    frame.keep_chroma(options.colour);
+    tracker.locate(frame, detector, options.threshold, faces);
+    recognise(state, frame, faces, model, options.interperson_period,
+              replacements);
+    final_image = compose(frame, faces, replacements, options, buffers,
+                          final_image);
+    if (options.check_allocations) {
+      check_allocations(frmCnt, allocations, bytes,
+                        frame.face_buffers() - face_buffers);
+    }
+    if (options.sink != NULL) {
+      options.sink->write(final_image);
+    }
     frmCnt++;
-    std::cout << "fps: " << 1.0/(totalT/(double)frmCnt) << std::endl;
+    if (options.display != NULL) {
+      options.display->write(final_image);
+      t = (static_cast<double>(cv::getTickCount())-t)/cv::getTickFrequency();
+      totalT += t;
+      std::cout << "fps: " << 1.0/(totalT/(double)frmCnt) << std::endl;
+    }
   }
-  std::cout << "greplace: Unexpected exit." << std::endl;
-  exit(EXIT_FAILURE);
+  return false;
 }
@@ -31,33 +31,143 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/objdetect/objdetect.hpp>
 
+#include <signal.h>
+
 #include "person.hpp"
+#include "capture.hpp"
+#include "detector.hpp"
+#include "options.hpp"
+#include "alpha_mask.hpp"
+#include "replacement_cache.hpp"
+#include "frame_context.hpp"
+#include "planner.hpp"
 
 namespace greplace {
-  void main_loop(cv::VideoCapture & capture,
-                 cv::CascadeClassifier cascade_classifier,
+  /* State carried from one frame to the next by the main loop */
+  struct FrameState {
+    FrameState(const greplace::Person & previous);
+    std::vector<cv::Rect> previous_faces;
+    std::vector<cv::Rect> faces;
+    greplace::Person previous;
+    greplace::Person current;
+    int timeSinceLastUser;
+    /* The faces seen in the last frame too, and the gallery faces for them */
+    std::vector<cv::Rect> steady;
+    std::vector<int> predicted;
+    greplace::PredictionBuffers prediction;
+  };
+
+  /* A replacement positioned over one face, as compose draws it */
+  struct Placement {
+    cv::Rect face;
+    /* Where TEXTURE and MASK go in the frame, clipped to it */
+    cv::Rect region;
+    cv::Mat texture;
+    cv::Mat mask;
+  };
+
+  /*
+   * Scratch images for compositing, kept from one frame to the next so the
+   * steady state loop allocates nothing. reserve sizes them for the largest
+   * face a frame can hold; without it they grow as larger faces turn up.
+   */
+  struct ComposeBuffers {
+    ComposeBuffers(void);
+    void reserve(cv::Size frame);
+    cv::Mat blended_grey;
+    cv::Mat alpha_mask;
+    cv::Mat reverse_alpha_mask;
+    cv::Mat feathered;
+    /* For colour output */
+    cv::Mat luma;
+    cv::Mat flat_chroma;
+    cv::Mat ycrcb;
+    /* One grey tile per thread composing tiles */
+    std::vector<cv::Mat> tiles;
+    std::vector<greplace::Placement> placements;
+    greplace::AlphaMaskCache masks;
+    greplace::ReplacementCache textures;
+  };
+
+  /* Returns true at the end of the input, false if the user stopped it */
+  bool main_loop(greplace::Capture & capture,
+                 greplace::Detector & detector,
+                 cv::Ptr<cv::FaceRecognizer> model,
+                 const greplace::Person & previous,
+                 const greplace::Options & options);
+
+  cv::Rect find_possible_face(greplace::FrameContext & frame,
+                              greplace::Detector & detector,
+                              int threshold, int scale = 1);
+  /* Up to MAX_FACES faces in the whole frame, as find_planned_faces */
+  void find_possible_faces(greplace::FrameContext & frame,
+                           greplace::Detector & detector, int threshold,
+                           int max_faces, int scale,
+                           std::vector<cv::Rect> & faces);
+  /* The largest face PLAN finds, in full resolution frame coordinates */
+  cv::Rect find_planned_face(greplace::FrameContext & frame,
+                             greplace::Detector & detector,
+                             int threshold, const greplace::DetectionPlan & plan);
+  /*
+   * Up to MAX_FACES of the faces PLAN finds, largest first, in full
+   * resolution frame coordinates. A face that overlaps a larger one is
+   * dropped, so no two replacements are drawn over the same pixels.
+   */
+  void find_planned_faces(greplace::FrameContext & frame,
+                          greplace::Detector & detector, int threshold,
+                          const greplace::DetectionPlan & plan, int max_faces,
+                          std::vector<cv::Rect> & faces);
+  /*
+   * Picks a replacement for each of FACES, largest first, into
+   * REPLACEMENTS. A face gets one once it overlaps a face of the last
+   * frame; all of those are recognised together. The largest face trains
+   * the gallery.
+   */
+  void recognise(FrameState & state, greplace::FrameContext & frame,
+                 const std::vector<cv::Rect> & faces,
                  cv::Ptr<cv::FaceRecognizer> model,
-                 greplace::Person previous,
-                 const int THRESHOLD,
                  const int INTERPERSON_PERIOD,
-                 const char * MAIN_WINDOW_TITLE);
+                 std::vector<greplace::Replacement> & replacements);
+  /*
+   * Smooths into FINAL_IMAGE if it is already the right size, and returns
+   * it. SMOOTH_SEAM returns the frame's grey plane instead. With
+   * options.tiles, SMOOTH_FRAME converts, draws and blurs the frame a tile
+   * at a time and leaves the grey plane alone. With options.colour the
+   * result is BGR, or YCrCb with options.ycrcb_output, composited on the
+   * luma only. With options.tiles, the faces are also drawn in parallel.
+   */
+  cv::Mat compose(greplace::FrameContext & frame,
+                  const std::vector<cv::Rect> & faces,
+                  const std::vector<greplace::Replacement> & replacements,
+                  const greplace::Options & options,
+                  greplace::ComposeBuffers & buffers,
+                  cv::Mat final_image = cv::Mat());
 
   cv::Mat get_new_training_face(cv::Mat image, cv::Rect face, 
-                                greplace::Person person);
-
-  cv::CascadeClassifier init(const char * CLASSIFIER_CONFIG);
+                                const greplace::Person & person);
+  cv::Mat get_new_training_face(greplace::FrameContext & frame, cv::Rect face,
+                                const greplace::Person & person);
 
   double dist(int x, int y, int rows, int columns);
 
-  cv::Rect get_largest_rect(cv::Vector<cv::Rect> rects);
+  cv::Rect get_largest_rect(const std::vector<cv::Rect> & rects);
 
   cv::Rect intersection(cv::Rect r1, cv::Rect r2);
   bool rects_overlap(cv::Rect r1, cv::Rect r2);
+  /* Set by exit_handler; the main loops stop at the next frame */
+  extern volatile sig_atomic_t exit_requested;
   void exit_handler(int signo);
+  void report_throughput(int frames, double start_ticks);
   cv::Mat to_grayscale(cv::Mat image);
-  cv::Mat find_face(cv::Mat image, cv::CascadeClassifier cascade_classifier,
+  cv::Mat find_face(cv::Mat image, greplace::Detector & detector,
                     int THRESHOLD);
   cv::Mat blend(cv::Mat face1, cv::Mat face2, double r0, double rf);
+  /* As above, but the result is a view into BUFFERS */
+  cv::Mat blend(cv::Mat face1, cv::Mat face2, double r0, double rf,
+                greplace::ComposeBuffers & buffers);
+  /* As above, counting the result into a calcHist style HISTOGRAM as it goes */
+  cv::Mat blend(cv::Mat face1, cv::Mat face2, double r0, double rf,
+                greplace::ComposeBuffers & buffers, cv::Mat & histogram);
 }
 
 #endif
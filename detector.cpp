@@ -0,0 +1,84 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+#include <iostream>
+
+#include "allocation.hpp"
+#include "cascade_cache.hpp"
+#include "detector.hpp"
+
+greplace::CascadeDetector::CascadeDetector(const char * path)
+  : cascade(path) { }
+
+bool greplace::CascadeDetector::loaded(void) const {
+  return !cascade.empty();
+}
+
+void greplace::CascadeDetector::detect(const cv::Mat & image,
+                                       std::vector<cv::Rect> & faces,
+                                       cv::Size min_size, cv::Size max_size) {
+  cascade.detectMultiScale(image, faces, 1.1, 3, 0, min_size, max_size);
+}
+
+greplace::NativeHaarDetector::NativeHaarDetector(
+    const greplace::HaarCascadeData & cascade, greplace::WorkerPool * pool)
+  : detector(cascade, pool) {
+  greplace::count_allocations(grey);
+}
+
+void greplace::NativeHaarDetector::detect(const cv::Mat & image,
+                                          std::vector<cv::Rect> & faces,
+                                          cv::Size min_size,
+                                          cv::Size max_size) {
+  if (image.channels() == 1) {
+    detector.detect(image, faces, 1.1, 3, min_size, max_size);
+  } else {
+    cvtColor(image, grey, CV_BGR2GRAY);
+    detector.detect(grey, faces, 1.1, 3, min_size, max_size);
+  }
+}
+
+greplace::Detector * greplace::create_detector(
+    greplace::DetectorBackend backend, const char * path,
+    greplace::WorkerPool * pool) {
+  if (backend == greplace::DETECT_NATIVE_HAAR) {
+    /* Brings its own tables, so OpenCV never parses the XML */
+    const greplace::HaarCascadeData * cascade = greplace::load_cascade(path);
+    if (cascade != NULL) {
+      return new greplace::NativeHaarDetector(*cascade, pool);
+    }
+    std::cout << "greplace: Using OpenCV's detector instead." << std::endl;
+  }
+  greplace::CascadeDetector * detector = new greplace::CascadeDetector(path);
+  if (!detector->loaded()) {
+    std::cout << "greplace: Could not load the cascade " << path << std::endl;
+    delete detector;
+    return NULL;
+  }
+  return detector;
+}
@@ -0,0 +1,90 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_DETECTOR_HPP
+#define _GREPLACE_DETECTOR_HPP
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+#include <vector>
+
+#include "haar.hpp"
+#include "options.hpp"
+
+namespace greplace {
+  class WorkerPool;
+
+  /*
+   * Finds faces for the main loops. Like the OpenCV cascades behind them,
+   * detectors are not safe to share between threads; create one per thread.
+   */
+  class Detector {
+  public:
+    virtual ~Detector(void) { }
+    /*
+     * As detectMultiScale(IMAGE, FACES, 1.1, 3, 0, MIN_SIZE, MAX_SIZE) on a
+     * grey or BGR IMAGE
+     */
+    virtual void detect(const cv::Mat & image, std::vector<cv::Rect> & faces,
+                        cv::Size min_size = cv::Size(),
+                        cv::Size max_size = cv::Size()) = 0;
+  };
+
+  /* An OpenCV cascade, Haar or LBP, whichever the XML holds */
+  class CascadeDetector : public Detector {
+  public:
+    explicit CascadeDetector(const char * path);
+    bool loaded(void) const;
+    void detect(const cv::Mat & image, std::vector<cv::Rect> & faces,
+                cv::Size min_size = cv::Size(),
+                cv::Size max_size = cv::Size());
+  private:
+    cv::CascadeClassifier cascade;
+  };
+
+  /* HaarDetector, shared out over POOL if given */
+  class NativeHaarDetector : public Detector {
+  public:
+    NativeHaarDetector(const greplace::HaarCascadeData & cascade,
+                       greplace::WorkerPool * pool);
+    void detect(const cv::Mat & image, std::vector<cv::Rect> & faces,
+                cv::Size min_size = cv::Size(),
+                cv::Size max_size = cv::Size());
+  private:
+    greplace::HaarDetector detector;
+    cv::Mat grey;
+  };
+
+  /*
+   * BACKEND's detector for the cascade in PATH, or NULL with a message. A
+   * cascade the native backend cannot run falls back to OpenCV's. POOL is
+   * only used by the native backend.
+   */
+  Detector * create_detector(greplace::DetectorBackend backend,
+                             const char * path,
+                             greplace::WorkerPool * pool = NULL);
+}
+
+#endif
@@ -0,0 +1,79 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+
+#include "display.hpp"
+
+/* How long the window waits for events before looking for a new frame */
+static const int DISPLAY_POLL_PERIOD = 5;
+
+greplace::Display::Display(std::string title, bool ycrcb)
+  : title(title), ycrcb(ycrcb), fresh(false), key(false), stopping(false) {
+  window = std::thread(&greplace::Display::run, this);
+}
+
+greplace::Display::~Display(void) {
+  stopping.store(true);
+  window.join();
+}
+
+void greplace::Display::write(const cv::Mat & frame) {
+  std::lock_guard<std::mutex> lock(mutex);
+  /* Reuses the buffer the window handed back last time */
+  frame.copyTo(mailbox);
+  fresh = true;
+}
+
+void greplace::Display::run(void) {
+  cv::Mat shown, bgr;
+  cv::namedWindow(title, CV_WINDOW_AUTOSIZE);
+  while (!stopping.load()) {
+    bool show = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (fresh) {
+        std::swap(mailbox, shown);
+        fresh = false;
+        show = true;
+      }
+    }
+    if (show && ycrcb && shown.channels() == 3) {
+      cvtColor(shown, bgr, CV_YCrCb2BGR);
+      cv::imshow(title, bgr);
+    } else if (show) {
+      cv::imshow(title, shown);
+    }
+    if (cv::waitKey(DISPLAY_POLL_PERIOD) >= 0) {
+      key.store(true);
+    }
+  }
+  cv::destroyWindow(title);
+}
@@ -0,0 +1,67 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_DISPLAY_HPP
+#define _GREPLACE_DISPLAY_HPP
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "sink.hpp"
+
+namespace greplace {
+  /*
+   * Shows frames in a window driven by its own thread, so the main loop
+   * never waits on imshow or waitKey. write() leaves the frame in a single
+   * slot mailbox, replacing any frame the window has not got to yet. A key
+   * press in the window is passed back through key_pressed().
+   *
+   * Every HighGUI call is made from the display thread, as is the
+   * conversion of YCrCb frames to BGR when the window is given those.
+   */
+  class Display : public Sink {
+  public:
+    Display(std::string title, bool ycrcb = false);
+    ~Display(void);
+    void write(const cv::Mat & frame);
+    bool key_pressed(void) const { return key.load(); }
+  private:
+    void run(void);
+    std::string title;
+    bool ycrcb;
+    std::mutex mutex;
+    cv::Mat mailbox;
+    bool fresh;
+    std::atomic<bool> key;
+    std::atomic<bool> stopping;
+    std::thread window;
+  };
+}
+
+#endif
@@ -0,0 +1,213 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "allocation.hpp"
+#include "frame_context.hpp"
+#include "kernels.hpp"
+
+greplace::FrameContext::FrameContext(void)
+  : read_only_grey(false), have_grey(false), chroma(false), face_sample(-1) {
+  greplace::count_allocations(grey_plane);
+  greplace::count_allocations(drawn_grey);
+  greplace::count_allocations(ycrcb);
+  greplace::count_allocations(cr_plane);
+  greplace::count_allocations(cb_plane);
+  for (int i = 0; i < SHRUNK_SLOTS; i++) {
+    small_factor[i] = 0;
+    small_fresh[i] = false;
+    greplace::count_allocations(small_grey[i]);
+  }
+  greplace::count_allocations(row_sums);
+  greplace::count_allocations(region_grey);
+}
+
+greplace::FrameContext::FrameContext(cv::Mat image)
+  : bgr(image), read_only_grey(false), have_grey(false), chroma(false),
+    face_sample(-1) {
+  greplace::count_allocations(grey_plane);
+  greplace::count_allocations(drawn_grey);
+  greplace::count_allocations(ycrcb);
+  greplace::count_allocations(cr_plane);
+  greplace::count_allocations(cb_plane);
+  for (int i = 0; i < SHRUNK_SLOTS; i++) {
+    small_factor[i] = 0;
+    small_fresh[i] = false;
+    greplace::count_allocations(small_grey[i]);
+  }
+  greplace::count_allocations(row_sums);
+  greplace::count_allocations(region_grey);
+}
+
+void greplace::FrameContext::reset(cv::Mat image) {
+  bgr = image;
+  borrowed_grey.release();
+  /* The grey plane is redrawn in place; the face sample may still be held */
+  have_grey = false;
+  for (int i = 0; i < SHRUNK_SLOTS; i++) {
+    small_fresh[i] = false;
+  }
+  face_sample = -1;
+}
+
+void greplace::FrameContext::reset_grey(cv::Mat luma, bool read_only) {
+  reset(cv::Mat());
+  /* Kept apart from grey_plane, which must not end up pointing at LUMA */
+  borrowed_grey = luma;
+  read_only_grey = read_only;
+  have_grey = true;
+}
+
+const cv::Mat & greplace::FrameContext::image(void) const {
+  return bgr;
+}
+
+cv::Size greplace::FrameContext::size(void) const {
+  return borrowed_grey.empty() ? bgr.size() : borrowed_grey.size();
+}
+
+cv::Mat & greplace::FrameContext::grey(void) {
+  if (!borrowed_grey.empty()) {
+    return borrowed_grey;
+  }
+  if (!have_grey && chroma) {
+    cvtColor(bgr, ycrcb, CV_BGR2YCrCb);
+    grey_plane.create(bgr.size(), CV_8UC1);
+    cr_plane.create(bgr.size(), CV_8UC1);
+    cb_plane.create(bgr.size(), CV_8UC1);
+    cv::Mat planes[] = { grey_plane, cr_plane, cb_plane };
+    const int from_to[] = { 0, 0, 1, 1, 2, 2 };
+    cv::mixChannels(&ycrcb, 1, planes, 3, from_to, 3);
+    have_grey = true;
+  } else if (!have_grey) {
+    cvtColor(bgr, grey_plane, CV_BGR2GRAY);
+    have_grey = true;
+  }
+  return grey_plane;
+}
+
+void greplace::FrameContext::keep_chroma(bool keep) {
+  chroma = keep;
+}
+
+cv::Mat & greplace::FrameContext::chroma_red(void) {
+  grey();
+  return cr_plane;
+}
+
+cv::Mat & greplace::FrameContext::chroma_blue(void) {
+  grey();
+  return cb_plane;
+}
+
+bool greplace::FrameContext::has_grey(void) const {
+  return have_grey;
+}
+
+cv::Mat & greplace::FrameContext::drawable_grey(void) {
+  if (!borrowed_grey.empty() && read_only_grey) {
+    cv::Mat copy = greplace::scratch(drawn_grey, borrowed_grey.size(),
+                                     CV_8UC1);
+    borrowed_grey.copyTo(copy);
+    borrowed_grey = copy;
+    read_only_grey = false;
+  }
+  return grey();
+}
+
+cv::Mat greplace::FrameContext::grey(cv::Rect region) {
+  if (have_grey) {
+    return grey()(region);
+  }
+  cv::Mat converted = greplace::scratch(region_grey, region.size(), CV_8UC1);
+  cvtColor(bgr(region), converted, CV_BGR2GRAY);
+  return converted;
+}
+
+const cv::Mat & greplace::FrameContext::detection_grey(int factor) {
+  if (factor == 1) {
+    return grey();
+  }
+  /* Reuse the slot that last held FACTOR, as its buffer is the right size */
+  int slot = -1;
+  for (int i = 0; i < SHRUNK_SLOTS && slot < 0; i++) {
+    if (small_factor[i] == factor) {
+      slot = i;
+    }
+  }
+  for (int i = 0; i < SHRUNK_SLOTS && slot < 0; i++) {
+    if (!small_fresh[i]) {
+      slot = i;
+    }
+  }
+  if (slot < 0) {
+    slot = SHRUNK_SLOTS - 1;
+  }
+  cv::Mat & small_image = small_grey[slot];
+  if (small_fresh[slot] && small_factor[slot] == factor) {
+    return small_image;
+  }
+  if (bgr.empty()) {
+    /* Whole FACTOR square blocks averaged, as the colour path does */
+    cv::Size small(size().width / factor, size().height / factor);
+    cv::Rect blocks(0, 0, small.width * factor, small.height * factor);
+    small_image.create(small, CV_8UC1);
+    cv::resize(grey()(blocks), small_image, small, 0, 0, cv::INTER_AREA);
+  } else {
+    greplace::bgr_to_grey_downscale(bgr, factor, small_image, row_sums);
+  }
+  small_factor[slot] = factor;
+  small_fresh[slot] = true;
+  return small_image;
+}
+
+const cv::Mat & greplace::FrameContext::face(cv::Rect face, cv::Size size) {
+  if (face_sample >= 0 && face == face_rect &&
+      face_samples[face_sample].size() == size) {
+    return face_samples[face_sample];
+  }
+  /* A buffer only the pool refers to is free; the gallery holds the rest */
+  face_sample = -1;
+  for (size_t i = 0; i < face_samples.size() && face_sample < 0; i ++) {
+    const cv::Mat & sample = face_samples[i];
+    if (sample.refcount == NULL ||
+        (*sample.refcount == 1 && sample.size() == size)) {
+      face_sample = static_cast<int>(i);
+    }
+  }
+  if (face_sample < 0) {
+    face_samples.push_back(cv::Mat());
+    greplace::count_allocations(face_samples.back());
+    face_sample = static_cast<int>(face_samples.size()) - 1;
+  }
+  resize(grey(face), face_samples[face_sample], size);
+  face_rect = face;
+  return face_samples[face_sample];
+}
+
+size_t greplace::FrameContext::face_buffers(void) const {
+  return face_samples.size();
+}
@@ -0,0 +1,121 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_FRAME_CONTEXT_HPP
+#define _GREPLACE_FRAME_CONTEXT_HPP
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <vector>
+
+#include <stddef.h>
+
+namespace greplace {
+  /*
+   * One captured frame and the images derived from it. Each derived image
+   * is computed the first time it is asked for and then reused, so a frame
+   * is converted to grey once no matter how many steps need it.
+   */
+  class FrameContext {
+  public:
+    FrameContext(void);
+    explicit FrameContext(cv::Mat image);
+    /* Moves on to a new frame, dropping everything derived from the last */
+    void reset(cv::Mat image);
+    /*
+     * Moves on to a frame that only has a luma plane. grey() is LUMA itself,
+     * not a copy, and image() is empty. A READ_ONLY plane is copied the
+     * first time drawable_grey() is asked for.
+     */
+    void reset_grey(cv::Mat luma, bool read_only = false);
+    const cv::Mat & image(void) const;
+    cv::Size size(void) const;
+    /* The frame in grey, for reading */
+    cv::Mat & grey(void);
+    /*
+     * grey(), once it is safe to draw into. compose draws the replacement
+     * faces into this, except when it works in tiles.
+     */
+    cv::Mat & drawable_grey(void);
+    /*
+     * Keeps the chroma when the frame is converted to grey, the grey plane
+     * then being the luma of a single conversion to planar YCrCb.
+     */
+    void keep_chroma(bool keep);
+    /* The Cr and Cb planes that go with grey(); needs keep_chroma */
+    cv::Mat & chroma_red(void);
+    cv::Mat & chroma_blue(void);
+    /* True once grey() has converted the whole frame */
+    bool has_grey(void) const;
+    /*
+     * REGION of the frame in grey. Only REGION is converted unless grey()
+     * already has been; the result may be overwritten by the next call.
+     */
+    cv::Mat grey(cv::Rect region);
+    /*
+     * The frame in grey, shrunk by FACTOR for the detector. Made straight
+     * from the colour frame, so it does not need grey() first. Each
+     * factor keeps its own buffer, so the scheduler and the detector
+     * asking for different factors in one frame do not evict each other.
+     */
+    const cv::Mat & detection_grey(int factor);
+    /*
+     * The grey face region scaled to SIZE, as recognition and training use.
+     * Training keeps it in the gallery, so it is drawn from a pool of
+     * counted buffers, reusing one only once nothing else holds it.
+     */
+    const cv::Mat & face(cv::Rect face, cv::Size size);
+    /*
+     * Buffers face() has added to its pool so far. The pool grows until the
+     * galleries are full, which takes longer than the allocation warm-up.
+     */
+    size_t face_buffers(void) const;
+  private:
+    cv::Mat bgr;
+    cv::Mat grey_plane;
+    cv::Mat borrowed_grey;
+    bool read_only_grey;
+    /* Where a read only BORROWED_GREY is copied to be drawn on */
+    cv::Mat drawn_grey;
+    bool have_grey;
+    bool chroma;
+    cv::Mat ycrcb;
+    cv::Mat cr_plane;
+    cv::Mat cb_plane;
+    /* One shrunk image per factor asked for; SMALL_FRESH marks this frame's */
+    static const int SHRUNK_SLOTS = 2;
+    cv::Mat small_grey[SHRUNK_SLOTS];
+    int small_factor[SHRUNK_SLOTS];
+    bool small_fresh[SHRUNK_SLOTS];
+    cv::Mat row_sums;
+    cv::Mat region_grey;
+    std::vector<cv::Mat> face_samples;
+    /* The pool entry face() last filled, or -1 once the frame has moved on */
+    int face_sample;
+    cv::Rect face_rect;
+  };
+}
+
+#endif
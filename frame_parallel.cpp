@@ -0,0 +1,138 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/contrib/contrib.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <stdlib.h>
+
+#include "cpu.hpp"
+#include "sink.hpp"
+#include "display.hpp"
+#include "reorder_buffer.hpp"
+#include "frame_parallel.hpp"
+
+bool greplace::frame_parallel_main_loop(greplace::Capture & capture,
+                                        cv::Ptr<cv::FaceRecognizer> model,
+                                        const greplace::Person & previous,
+                                        const greplace::Options & options) {
+  greplace::ReorderBuffer<cv::Mat> output(2 * options.workers);
+  greplace::FrameState state(previous);
+  std::mutex capture_mutex, state_mutex;
+  std::condition_variable state_turn;
+  size_t captured = 0, recognised = 0;
+  std::atomic<bool> running(true);
+  std::atomic<int> active(options.workers);
+  signal(SIGINT, greplace::exit_handler);
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < options.workers; i ++) {
+    workers.push_back(std::thread([&]() {
+      greplace::Detector * detector = greplace::create_detector(
+          options.detector, options.classifier_config, options.detections);
+      if (detector == NULL) {
+        running.store(false);
+      }
+      greplace::ComposeBuffers buffers;
+      std::vector<cv::Rect> faces;
+      std::vector<greplace::Replacement> replacements;
+      while (running.load() && !greplace::exit_requested) {
+        greplace::FrameContext frame;
+        size_t sequence;
+        {
+          std::lock_guard<std::mutex> lock(capture_mutex);
+          /* Kept, as other workers read on while this frame is processed */
+          if (!capture.read(frame, true)) {
+            break;
+          }
+          sequence = captured++;
+        }
+        frame.keep_chroma(options.colour);
+        find_possible_faces(frame, *detector, options.threshold,
+                            options.max_faces, options.detect_scale, faces);
+        {
+          std::unique_lock<std::mutex> lock(state_mutex);
+          state_turn.wait(lock, [&]() { return recognised == sequence; });
+          recognise(state, frame, faces, model, options.interperson_period,
+                    replacements);
+          recognised++;
+          state_turn.notify_all();
+        }
+        cv::Mat final_image = compose(frame, faces, replacements,
+                                      options, buffers);
+        if (!output.put(sequence, final_image)) {
+          break;
+        }
+      }
+      delete detector;
+      if (--active == 0) {
+        output.close();
+      }
+    }));
+  }
+
+  cv::Mat final_image;
+  int frmCnt = 0;
+  bool interrupted = false;
+  double start = static_cast<double>(cv::getTickCount());
+  while (output.take(final_image)) {
+    if (options.sink != NULL) {
+      options.sink->write(final_image);
+    }
+    frmCnt++;
+    if (options.display == NULL) {
+      continue;
+    }
+    options.display->write(final_image);
+    double totalT = (static_cast<double>(cv::getTickCount()) - start) /
+                    cv::getTickFrequency();
+    std::cout << "fps: " << frmCnt / totalT << std::endl;
+    if (options.display->key_pressed()) {
+      interrupted = true;
+      break;
+    }
+  }
+  running.store(false);
+  output.close();
+  for (size_t i = 0; i < workers.size(); i ++) {
+    workers[i].join();
+  }
+  if (!interrupted) {
+    /* End of the input */
+    greplace::report_throughput(frmCnt, start);
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,60 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_FRAME_PARALLEL_HPP
+#define _GREPLACE_FRAME_PARALLEL_HPP
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/contrib/contrib.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "person.hpp"
+#include "capture.hpp"
+#include "options.hpp"
+
+namespace greplace {
+  /*
+   * Runs the main loop on options.workers threads, each taking the next captured
+   * frame and running the whole per-frame body on it. Results are put back
+   * into capture order before they are displayed.
+   *
+   * Ordering contract: find_possible_faces and compose only
+   * touch their own frame and run concurrently. recognise owns the state
+   * carried between frames (previous_faces, the current and previous Person,
+   * timeSinceLastUser and the model) and runs for one frame at a time, in
+   * capture order, so each frame sees exactly the state the serial loop
+   * would have given it.
+   *
+   * Detectors are not safe to share between threads, so every worker
+   * creates its own from options.detector and options.classifier_config.
+   *
+   * Returns as main_loop does.
+   */
+  bool frame_parallel_main_loop(greplace::Capture & capture,
+                                cv::Ptr<cv::FaceRecognizer> model,
+                                const greplace::Person & previous,
+                                const greplace::Options & options);
+}
+
+#endif
@@ -202,7 +202,7 @@ void greplace::gpu::main_loop(cv::VideoCapture capture,
 	double totalT = 0.0;
 	double t;
   signal(SIGINT, greplace::exit_handler);
-	while (cv::waitKey(2) < 0) {
+	while (!greplace::exit_requested && cv::waitKey(2) < 0) {
 		capture >> image;
 		imageGpu = cv::gpu::GpuMat(image);
 		t = (double) cv::getTickCount();
@@ -239,6 +239,10 @@ void greplace::gpu::main_loop(cv::VideoCapture capture,
 		frmCnt++;
 		std::cout << "fps: " << 1.0/(totalT/(double)frmCnt) << std::endl;
 	}
+  if (greplace::exit_requested) {
+    std::cout << std::endl << "greplace: User entered kill signal" << std::endl;
+    exit(EXIT_SUCCESS);
+  }
   std::cout << "greplace: error in main loop. Ending program execution." << std::endl;
   exit(EXIT_FAILURE);
 }
@@ -43,6 +43,7 @@
 #include "person.hpp"
 #include "greplace-psearch-cpu.hpp"
 #include "cpu.hpp"
+#include "kernels.hpp"
 #include "cmake_config.h"
 
 static const char *optString = "s:t:e:f:m:n";
@@ -72,15 +73,7 @@ double greplace::hist_correlation(cv::Mat H1, cv::Mat H2) {
 }
 
 cv::Mat greplace::hist(cv::Mat const & image) {
-	int bins = 256;
-  int histSize[] = {bins};
-  float lranges[] = {0, 256};
-  const float * ranges[] = {lranges};
-  int channels[] = {0};
-  cv::Mat hist;
-  cv::calcHist(&image, 1, channels, cv::Mat(), hist, 1, histSize, ranges, true,
-               false);
-  return hist;
+  return greplace::grey_histogram(image);
 }
 
 std::vector<cv::Mat> greplace::hists(std::vector<cv::Mat> & faces) {
@@ -92,9 +85,10 @@ std::vector<cv::Mat> greplace::hists(std::vector<cv::Mat> & faces) {
 }
 
 double greplace::find_statistic(std::vector<cv::Mat> images, std::vector<cv::Mat> hists, double r0,
-                               double rf, cv::CascadeClassifier & classifier,
+                               double rf, greplace::Detector & classifier,
                                double & std_d) {
   std::vector<double> statistic;
+  greplace::ComposeBuffers buffers;
   for (size_t i = 0; i < images.size(); i ++) {
       auto face1 = images[i];
       auto hist1 = hists[i];
@@ -102,12 +96,13 @@ double greplace::find_statistic(std::vector<cv::Mat> images, std::vector<cv::Mat
           auto face2 = images[j];
           auto hist2 = hists[j];
 		      cv::resize(face2, face2, face1.size());
-		      cv::Mat face3 = greplace::blend(face1, face2, r0, rf);
+		      cv::Mat hist3;
+		      cv::Mat face3 = greplace::blend(face1, face2, r0, rf, buffers,
+		                                      hist3);
           cv::imshow("Host", face1);
           cv::imshow("Replacement", face2);
           cv::imshow("Blended", face3);
           cv::waitKey(3000);
-		      cv::Mat hist3 = hist(face3);
 		      double s = hist_correlation(hist1, hist3) + hist_correlation(hist2, hist3);
 		      statistic.push_back(s);
 		  }
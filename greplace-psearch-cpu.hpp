@@ -35,6 +35,8 @@
 #include <iostream>
 #include <sstream>
 
+#include "detector.hpp"
+
 namespace greplace {
 
 	double mean(std::vector<double> set);
@@ -44,7 +46,7 @@ namespace greplace {
 	cv::Mat hist(cv::Mat const & image);
 
 	double find_statistic(std::vector<cv::Mat> images, std::vector<cv::Mat> hists, double r0,
-		                    double rf, cv::CascadeClassifier & classifier, double &
+		                    double rf, greplace::Detector & classifier, double &
                         standard_deviation);
 
   std::vector<cv::Mat> hists(std::vector<cv::Mat> & faces);
@@ -48,6 +48,8 @@
 #endif
 #include "person.hpp"
 #include "cpu.hpp"
+#include "haar.hpp"
+#include "parallel.hpp"
 #include "cmake_config.h"
 
 static const char *optString = "s:t:e:f:m:n";
@@ -64,9 +66,11 @@ static const struct option longOpts[] = {
   {"delta_r0",    required_argument, NULL, 'm'},
   {"delta_rf",    required_argument, NULL, 'n'},
   {"cpu",         no_argument,       NULL, 'c'},
+  {"detect_threads", required_argument, NULL, 'D'},
   {"help",        no_argument,       NULL, 'h'},
   {"usage",       no_argument,       NULL, 'h'},
-  {"verbose",     no_argument,       NULL, 'v'}
+  {"verbose",     no_argument,       NULL, 'v'},
+  {NULL,          0,                 NULL, 0}
 };
 
 void display_help(void) {
@@ -92,6 +96,10 @@ void display_help(void) {
   std::cout << "    -n, --delta_rf"                               << std::endl;
   std::cout << "        Sets the step size for rf. Defaults to 0.1";
   std::cout << std::endl;
+  std::cout << "    -D, --detect_threads"                         << std::endl;
+  std::cout << "        Finds faces with the native cascade, shared ";
+  std::cout << "between this many threads. Defaults to 0 (OpenCV's ";
+  std::cout << "detector)."                                       << std::endl;
   std::cout << "    -v, --verbose"                                << std::endl;
   std::cout << "        Makes greplace-psearch output additional ";
   std::cout << "information."                                     << std::endl;
@@ -102,7 +110,7 @@ void display_help(void) {
 
 void get_options(int argc, char ** argv, double & r00, double & r0f,
                  double & rf0, double & rff, double & delta_r0,
-                 double & delta_rf, bool & verbosity) {
+                 double & delta_rf, bool & verbosity, int & detect_threads) {
   int optIndex[1];
   int opt;
   while ((opt = getopt_long(argc, argv, optString, longOpts, optIndex)) != -1) {
@@ -127,6 +135,9 @@ void get_options(int argc, char ** argv, double & r00, double & r0f,
     case 'n':
 			delta_rf = atof(optarg);
       break;
+    case 'D':
+			detect_threads = atoi(optarg);
+      break;
     case 'v':
       verbosity = true;
       break;
@@ -160,7 +171,13 @@ std::vector<std::string> test_files (const char * dir_name) {
 int main(int argc, char ** argv) {
 	double r00 = 0.6, r0f = 1, rf0 = 0.8, rff = 1, delta_r0 = 0.05, delta_rf = 0.05;
 	bool verbose = false;
-  get_options(argc, argv, r00, r0f, rf0, rff, delta_r0, delta_rf, verbose);
+  int detect_threads = 0;
+  get_options(argc, argv, r00, r0f, rf0, rff, delta_r0, delta_rf, verbose,
+              detect_threads);
+  greplace::WorkerPool * detections = NULL;
+  if (detect_threads > 0) {
+    detections = new greplace::WorkerPool(detect_threads);
+  }
   std::vector<std::string> images = test_files(IMAGE_DIR);
   std::vector<cv::Mat> images_mat;
   for (auto i : images) {
@@ -173,15 +190,19 @@ int main(int argc, char ** argv) {
     }
   }
   #ifndef HAVE_GPU
-  cv::CascadeClassifier classifier = greplace::init(
-                                            HAAR_CASCADE_FRONTAL_FACE_LOCATION);
+  greplace::Detector * classifier = greplace::create_detector(
+      detections != NULL ? greplace::DETECT_NATIVE_HAAR : greplace::DETECT_HAAR,
+      HAAR_CASCADE_FRONTAL_FACE_LOCATION, detections);
+  if (classifier == NULL) {
+    return EXIT_FAILURE;
+  }
   #else
   cv::gpu::CascadeClassifier_GPU classifier = greplace::gpu::init(HAAR_CASCADE_FRONTAL_FACE_LOCATION, 0);
   #endif
   std::vector<cv::Mat> faces;
   for (auto i : images_mat) {
     try {
-      auto face = greplace::find_face(i, classifier, 16);
+      auto face = greplace::find_face(i, *classifier, 16);
       faces.push_back(face);
     } catch (...) {
 
@@ -195,11 +216,15 @@ int main(int argc, char ** argv) {
   for (double r0 = r00; r0 <= r0f; r0 += delta_r0) {
     for (double rf = rf0; rf <= rff; rf += delta_rf) {
 #ifndef HAVE_GPU
-			double s = greplace::find_statistic(faces, hists, r0, rf, classifier, std_d);
+			double s = greplace::find_statistic(faces, hists, r0, rf, *classifier, std_d);
 #else
       double s = greplace::gpu::find_statistic(faces, hists, r0, rf, classifier);
 #endif
 			std::cout << r0 << ", " << rf << ", " << s << ", " << std_d << std::endl;
     }
   }
+#ifndef HAVE_GPU
+  delete classifier;
+#endif
+  delete detections;
 }
@@ -0,0 +1,274 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+#include <algorithm>
+
+#include <math.h>
+#include <string.h>
+
+#include "allocation.hpp"
+#include "haar.hpp"
+#include "haar_frontalface.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+/* OpenCV lowers every stage threshold by this much when it loads a cascade */
+static const double STAGE_THRESHOLD_BIAS = 0.0001;
+/* cvHaarDetectObjects' grouping tolerance */
+static const double GROUP_EPS = 0.2;
+
+/* Window rows per band: enough to amortise a task, few enough to balance */
+static const int BAND_ROWS = 8;
+
+/* cvRound: to nearest, halves to even */
+static int round_even(double v) {
+  return static_cast<int>(lrint(v));
+}
+
+/* Element offsets of a rectangle's corners, STEP elements to a row */
+static void rect_corners(int x, int y, int width, int height, int step,
+                         int * corners) {
+  corners[0] = y * step + x;
+  corners[1] = y * step + x + width;
+  corners[2] = (y + height) * step + x;
+  corners[3] = (y + height) * step + x + width;
+}
+
+const greplace::HaarCascadeData & greplace::frontal_face_cascade(void) {
+  using namespace greplace::frontalface;
+  static const greplace::HaarCascadeData cascade = {
+    WINDOW_WIDTH, WINDOW_HEIGHT, STAGE_COUNT, STUMP_COUNT, STAGES, STUMPS,
+    XML_HASH
+  };
+  return cascade;
+}
+
+greplace::HaarDetector::HaarDetector(const greplace::HaarCascadeData & cascade,
+                                     greplace::WorkerPool * pool)
+  : tables(cascade), pool(pool) {
+  greplace::count_allocations(sum_storage);
+  greplace::count_allocations(sqsum_storage);
+}
+
+/* As cvSetImagesForHaarClassifierCascade, rounding and all */
+const greplace::HaarScaledCascade &
+greplace::HaarDetector::prepare(size_t index, double factor, int step) {
+  Scale & scale = scales[index];
+  if (scale.stumps.empty() || scale.factor != factor || scale.step != step) {
+    scale.factor = factor;
+    scale.step = step;
+    scale.stages.resize(tables.stage_count);
+    for (int i = 0; i < tables.stage_count; i ++) {
+      const HaarStage & s = tables.stages[i];
+      HaarScaledStage & stage = scale.stages[i];
+      stage.threshold = static_cast<float>(s.threshold - STAGE_THRESHOLD_BIAS);
+      stage.first = s.first;
+      stage.count = s.count;
+      stage.two_rects = s.two_rects;
+    }
+
+    int edge = round_even(factor);
+    int width = round_even((tables.window_width - 2) * factor);
+    int height = round_even((tables.window_height - 2) * factor);
+    double weight_scale = 1. / (width * height);
+    rect_corners(edge, edge, width, height, step, scale.cascade.window);
+    scale.cascade.inv_window_area = weight_scale;
+
+    scale.stumps.resize(tables.stump_count);
+    for (int i = 0; i < tables.stump_count; i ++) {
+      const HaarStump & s = tables.stumps[i];
+      HaarScaledStump & t = scale.stumps[i];
+      memset(&t, 0, sizeof(t));
+      t.threshold = s.threshold;
+      t.left = s.left;
+      t.right = s.right;
+      t.rect_count = s.rect_count;
+      /* The first rectangle's weight balances the others at this size */
+      double sum0 = 0, area0 = 0;
+      for (int k = 0; k < s.rect_count; k ++) {
+        const HaarRect & r = s.rects[k];
+        int w = round_even(r.width * factor);
+        int h = round_even(r.height * factor);
+        rect_corners(round_even(r.x * factor), round_even(r.y * factor), w, h,
+                     step, t.corners[k]);
+        t.weights[k] = static_cast<float>(r.weight * weight_scale);
+        if (k == 0) {
+          area0 = w * h;
+        } else {
+          sum0 += t.weights[k] * w * h;
+        }
+      }
+      t.weights[0] = static_cast<float>(-sum0 / area0);
+    }
+  }
+  scale.cascade.stumps = &scale.stumps[0];
+  scale.cascade.stages = &scale.stages[0];
+  scale.cascade.stage_count = static_cast<int>(scale.stages.size());
+  return scale.cascade;
+}
+
+void greplace::HaarDetector::run(int count,
+                                 const std::function<void(int, int)> & task) {
+  if (pool != NULL) {
+    pool->run(count, task);
+  } else {
+    for (int i = 0; i < count; i ++) {
+      task(i, 0);
+    }
+  }
+}
+
+/* The windows of one band, in the order and with the skipping OpenCV uses */
+void greplace::HaarDetector::scan(const Band & band, const cv::Mat & sum,
+                                  const cv::Mat & sqsum, Scratch & scratch,
+                                  std::vector<cv::Rect> & found) {
+  const Level & level = levels[band.level];
+  const greplace::HaarScaledCascade & cascade = scales[level.index].cascade;
+  int step = static_cast<int>(sum.step1());
+  const greplace::KernelTable & k = greplace::kernels();
+  found.clear();
+  for (int iy = band.first; iy < band.last; iy ++) {
+    int y = round_even(iy * level.ystep);
+    /* Windows must end inside the integral image; columns only grow */
+    int count = 0;
+    if (y + level.window.height < sum.rows) {
+      while (count < level.end_x &&
+             level.columns[count] + level.window.width < sum.cols) {
+        count++;
+      }
+    }
+    scratch.offsets.resize(count);
+    scratch.results.resize(count);
+    for (int ix = 0; ix < count; ix ++) {
+      scratch.offsets[ix] = y * step + level.columns[ix];
+    }
+    if (count > 0) {
+      k.haar_windows(cascade, sum.ptr<int>(), sqsum.ptr<double>(),
+                     &scratch.offsets[0], count, &scratch.results[0]);
+    }
+    for (int ix = 0, ixstep = 1; ix < level.end_x; ix += ixstep) {
+      int result = ix < count ? scratch.results[ix] : -1;
+      if (result > 0) {
+        found.push_back(cv::Rect(level.columns[ix], y, level.window.width,
+                                 level.window.height));
+      }
+      ixstep = result != 0 ? 1 : 2;
+    }
+  }
+}
+
+/*
+ * cvHaarDetectObjectsForROC without CV_HAAR_SCALE_IMAGE: the same scales,
+ * window positions and skipping, so the same candidates reach grouping.
+ * Each row's windows go to the kernels in one batch; skipped windows are
+ * evaluated too, since which ones get skipped depends on the results.
+ * Bands are gathered back in scale and row order, as OpenCV would find
+ * them, so grouping sees the same list whatever the thread count.
+ */
+void greplace::HaarDetector::detect(const cv::Mat & grey,
+                                    std::vector<cv::Rect> & faces,
+                                    double scale_factor, int min_neighbours,
+                                    cv::Size min_size, cv::Size max_size) {
+  CV_Assert(grey.type() == CV_8UC1);
+  faces.clear();
+  candidates.clear();
+  if (max_size.width == 0 || max_size.height == 0) {
+    max_size = cv::Size(grey.cols, grey.rows);
+  }
+  cv::Size integral_size(grey.cols + 1, grey.rows + 1);
+  cv::Mat sum = greplace::scratch(sum_storage, integral_size, CV_32SC1);
+  cv::Mat sqsum = greplace::scratch(sqsum_storage, integral_size, CV_64FC1);
+  cv::integral(grey, sum, sqsum);
+  /* Both storages grow in step, so one offset serves both */
+  CV_Assert(sum.step1() == sqsum.step1());
+  int step = static_cast<int>(sum.step1());
+
+  size_t level_count = 0;
+  size_t index = 0;
+  for (double factor = 1; factor * tables.window_width < grey.cols - 10 &&
+                          factor * tables.window_height < grey.rows - 10;
+       factor *= scale_factor, index ++) {
+    cv::Size window(round_even(tables.window_width * factor),
+                    round_even(tables.window_height * factor));
+    if (window.width < min_size.width || window.height < min_size.height) {
+      continue;
+    }
+    if (window.width > max_size.width || window.height > max_size.height) {
+      break;
+    }
+    if (levels.size() <= level_count) {
+      levels.resize(level_count + 1);
+    }
+    Level & level = levels[level_count++];
+    level.index = index;
+    level.factor = factor;
+    level.ystep = std::max(2., factor);
+    level.window = window;
+    level.end_x = round_even((grey.cols - window.width) / level.ystep);
+    level.end_y = round_even((grey.rows - window.height) / level.ystep);
+    level.columns.resize(std::max(level.end_x, 0));
+    for (int ix = 0; ix < level.end_x; ix ++) {
+      level.columns[ix] = round_even(ix * level.ystep);
+    }
+  }
+  if (level_count == 0) {
+    return;
+  }
+
+  if (scales.size() <= levels[level_count - 1].index) {
+    scales.resize(levels[level_count - 1].index + 1);
+  }
+  run(static_cast<int>(level_count), [&](int i, int) {
+    prepare(levels[i].index, levels[i].factor, step);
+  });
+
+  bands.clear();
+  for (size_t i = 0; i < level_count; i ++) {
+    for (int first = 0; first < levels[i].end_y; first += BAND_ROWS) {
+      Band band;
+      band.level = static_cast<int>(i);
+      band.first = first;
+      band.last = std::min(first + BAND_ROWS, levels[i].end_y);
+      bands.push_back(band);
+    }
+  }
+  if (found.size() < bands.size()) {
+    found.resize(bands.size());
+  }
+  worker_scratch.resize(pool != NULL ? pool->size() : 1);
+  run(static_cast<int>(bands.size()), [&](int b, int worker) {
+    scan(bands[b], sum, sqsum, worker_scratch[worker], found[b]);
+  });
+  for (size_t b = 0; b < bands.size(); b ++) {
+    candidates.insert(candidates.end(), found[b].begin(), found[b].end());
+  }
+
+  if (min_neighbours != 0) {
+    cv::groupRectangles(candidates, std::max(min_neighbours, 1), GROUP_EPS);
+  }
+  faces.swap(candidates);
+}
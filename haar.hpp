@@ -0,0 +1,104 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_HAAR_HPP
+#define _GREPLACE_HAAR_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <functional>
+#include <vector>
+
+#include "haar_cascade.hpp"
+
+namespace greplace {
+  class WorkerPool;
+
+  /* haarcascade_frontalface_default.xml, compiled into the binary */
+  const greplace::HaarCascadeData & frontal_face_cascade(void);
+
+  /*
+   * A stump based cascade (by default the compiled in frontal face one) run
+   * several windows at a time by the SIMD kernels. detect() finds the same
+   * faces as OpenCV 2.4's CascadeClassifier::detectMultiScale with the
+   * cascade's XML file and flags 0. CASCADE must outlive it. Given a
+   * pool, it shares the scales and bands of rows out over it; each pool
+   * thread has its own scratch and they all read the one integral image and
+   * the prepared scales. Not thread safe; use one per thread.
+   */
+  class HaarDetector {
+  public:
+    explicit HaarDetector(const greplace::HaarCascadeData & cascade =
+                              greplace::frontal_face_cascade(),
+                          greplace::WorkerPool * pool = NULL);
+    void detect(const cv::Mat & grey, std::vector<cv::Rect> & faces,
+                double scale_factor = 1.1, int min_neighbours = 3,
+                cv::Size min_size = cv::Size(),
+                cv::Size max_size = cv::Size());
+  private:
+    /* The cascade prepared for one factor, kept while the step holds */
+    struct Scale {
+      double factor;
+      int step;
+      std::vector<HaarScaledStump> stumps;
+      std::vector<HaarScaledStage> stages;
+      HaarScaledCascade cascade;
+    };
+    /* One scale this call searches, and its window positions */
+    struct Level {
+      size_t index;
+      double factor;
+      double ystep;
+      cv::Size window;
+      int end_x, end_y;
+      std::vector<int> columns;
+    };
+    /* Rows [first, last) of a level; the unit of work */
+    struct Band {
+      int level;
+      int first, last;
+    };
+    struct Scratch {
+      std::vector<int> offsets;
+      std::vector<int> results;
+    };
+    const HaarScaledCascade & prepare(size_t index, double factor, int step);
+    void scan(const Band & band, const cv::Mat & sum, const cv::Mat & sqsum,
+              Scratch & scratch, std::vector<cv::Rect> & found);
+    void run(int count, const std::function<void(int, int)> & task);
+
+    const greplace::HaarCascadeData & tables;
+    greplace::WorkerPool * pool;
+    cv::Mat sum_storage;
+    cv::Mat sqsum_storage;
+    std::vector<Scale> scales;
+    std::vector<Level> levels;
+    std::vector<Band> bands;
+    std::vector<Scratch> worker_scratch;
+    std::vector<std::vector<cv::Rect> > found;
+    std::vector<cv::Rect> candidates;
+  };
+}
+
+#endif
@@ -0,0 +1,93 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_HAAR_CASCADE_HPP
+#define _GREPLACE_HAAR_CASCADE_HPP
+
+namespace greplace {
+  /*
+   * A stump based Haar cascade as haar_codegen writes it out: literal types,
+   * so the generated tables are constexpr. Rectangles are in the 24 x 24 (or
+   * whatever the cascade says) base window.
+   */
+  struct HaarRect {
+    int x, y, width, height;
+    float weight;
+  };
+
+  struct HaarStump {
+    float threshold;
+    float left, right;
+    int rect_count;
+    HaarRect rects[3];
+  };
+
+  struct HaarStage {
+    float threshold;
+    int first, count;
+    /* No stump in the stage has a third rectangle */
+    bool two_rects;
+  };
+
+  /* A cascade's tables and base window, wherever they are stored */
+  struct HaarCascadeData {
+    int window_width, window_height;
+    int stage_count, stump_count;
+    const HaarStage * stages;
+    const HaarStump * stumps;
+    /* haar_cascade_hash of the XML it came from */
+    unsigned long long xml_hash;
+  };
+
+  /*
+   * A cascade prepared for one scale and one integral image row step, as
+   * cvSetImagesForHaarClassifierCascade prepares it. Corners are element
+   * offsets from a window's top left corner, in the order
+   * top left, top right, bottom left, bottom right.
+   */
+  struct HaarScaledStump {
+    int corners[3][4];
+    float weights[3];
+    float threshold;
+    float left, right;
+    int rect_count;
+  };
+
+  struct HaarScaledStage {
+    float threshold;
+    int first, count;
+    bool two_rects;
+  };
+
+  struct HaarScaledCascade {
+    const HaarScaledStump * stumps;
+    const HaarScaledStage * stages;
+    int stage_count;
+    /* The variance normalisation window */
+    int window[4];
+    double inv_window_area;
+  };
+}
+
+#endif
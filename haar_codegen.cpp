@@ -0,0 +1,143 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Build time tool: turns an old style (stump based, untilted) OpenCV Haar
+ * cascade XML file into a header of constexpr tables for haar.cpp.
+ *
+ *     haar_codegen <cascade.xml> <output.hpp> <namespace>
+ *
+ * Values go through float exactly as cvLoad stores them, and are printed
+ * with enough digits to come back to the same float.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cascade_xml.hpp"
+
+static void fail(const std::string & message) {
+  std::cerr << "haar_codegen: " << message << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+/* A float literal that reads back as exactly V */
+static std::string literal(float v) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.9g", v);
+  std::string s = buffer;
+  if (s.find_first_of(".e") == std::string::npos) {
+    s += ".";
+  }
+  return s + "f";
+}
+
+static void write(std::ostream & out, const greplace::ParsedCascade & cascade,
+                  unsigned long long hash, const std::string & name) {
+  std::string guard = "_GREPLACE_HAAR_" + name + "_HPP";
+  for (size_t i = 0; i < guard.size(); i ++) {
+    guard[i] = toupper(guard[i]);
+  }
+  out << "/* Generated by haar_codegen; do not edit */" << std::endl;
+  out << std::endl;
+  out << "#ifndef " << guard << std::endl;
+  out << "#define " << guard << std::endl;
+  out << std::endl;
+  out << "#include \"haar_cascade.hpp\"" << std::endl;
+  out << std::endl;
+  out << "namespace greplace {" << std::endl;
+  out << "namespace " << name << " {" << std::endl;
+  out << "  constexpr int WINDOW_WIDTH = " << cascade.width << ";" << std::endl;
+  out << "  constexpr int WINDOW_HEIGHT = " << cascade.height << ";"
+      << std::endl;
+  out << "  constexpr int STAGE_COUNT = " << cascade.stages.size() << ";"
+      << std::endl;
+  out << "  constexpr int STUMP_COUNT = " << cascade.stumps.size() << ";"
+      << std::endl;
+  out << "  /* haar_cascade_hash of the XML these came from */" << std::endl;
+  out << "  constexpr unsigned long long XML_HASH = " << hash << "ULL;"
+      << std::endl;
+  out << std::endl;
+  out << "  constexpr HaarStage STAGES[STAGE_COUNT] = {" << std::endl;
+  for (size_t i = 0; i < cascade.stages.size(); i ++) {
+    const greplace::HaarStage & s = cascade.stages[i];
+    out << "    {" << literal(s.threshold) << ", " << s.first << ", "
+        << s.count << ", " << (s.two_rects ? "true" : "false") << "},"
+        << std::endl;
+  }
+  out << "  };" << std::endl;
+  out << std::endl;
+  out << "  constexpr HaarStump STUMPS[STUMP_COUNT] = {" << std::endl;
+  for (size_t i = 0; i < cascade.stumps.size(); i ++) {
+    const greplace::HaarStump & s = cascade.stumps[i];
+    out << "    {" << literal(s.threshold) << ", " << literal(s.left) << ", "
+        << literal(s.right) << ", " << s.rect_count << ", {";
+    for (int k = 0; k < 3; k ++) {
+      const greplace::HaarRect & r = s.rects[k];
+      out << (k > 0 ? ", " : "") << "{" << r.x << ", " << r.y << ", "
+          << r.width << ", " << r.height << ", " << literal(r.weight) << "}";
+    }
+    out << "}}," << std::endl;
+  }
+  out << "  };" << std::endl;
+  out << "}" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "#endif" << std::endl;
+}
+
+int main(int argc, char ** argv) {
+  if (argc != 4) {
+    std::cerr << "usage: haar_codegen <cascade.xml> <output.hpp> <namespace>"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::ifstream in(argv[1]);
+  if (!in) {
+    fail(std::string("cannot read ") + argv[1]);
+  }
+  std::stringstream xml;
+  xml << in.rdbuf();
+  std::string text = xml.str();
+  greplace::ParsedCascade cascade;
+  std::string error;
+  if (!greplace::parse_haar_cascade(text, cascade, error)) {
+    fail(error);
+  }
+
+  std::ofstream out(argv[2]);
+  write(out, cascade, greplace::haar_cascade_hash(text.data(), text.size()),
+        argv[3]);
+  if (!out) {
+    fail(std::string("cannot write ") + argv[2]);
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_KERNEL_TABLE_HPP
+#define _GREPLACE_KERNEL_TABLE_HPP
+
+#include <stddef.h>
+
+#include "haar_cascade.hpp"
+
+namespace greplace {
+  typedef unsigned char uchar;
+  typedef unsigned short ushort;
+
+  /*
+   * The row level pixel kernels, compiled once per instruction set from
+   * kernels_impl.hpp. kernels.cpp picks one table at startup.
+   */
+  struct KernelTable {
+    const char * name;
+    /* Sums FACTOR BGR rows into SUMS, then writes COLS grey block averages */
+    void (*downscale_row)(const uchar * const * rows, int factor, int cols,
+                          ushort * sums, uchar * dst);
+    /* One row of expr::Lerp over planes; B is NULL for an opaque destination */
+    void (*blend_row)(const uchar * s, const uchar * a, const uchar * d,
+                      const uchar * b, uchar * o, int n);
+    /* One row of radial_alpha_mask, DR rows from the centre */
+    void (*alpha_mask_row)(double dr, double centre_col, double max_dist,
+                           double r0, double rf, bool reverse, uchar * dst,
+                           int cols);
+    /* Adds a ROWS x COLS grey image into 256 BINS */
+    void (*histogram)(const uchar * data, size_t step, int rows, int cols,
+                      unsigned int * bins);
+    /*
+     * Runs CASCADE at COUNT windows, OFFSETS elements from SUM and SQSUM
+     * (integral images sharing one element step). Each result is 1 for a
+     * pass, or minus the stage that rejected the window.
+     */
+    void (*haar_windows)(const HaarScaledCascade & cascade, const int * sum,
+                         const double * sqsum, const int * offsets, int count,
+                         int * results);
+  };
+
+  namespace scalar { extern const KernelTable kernels; }
+#ifdef GREPLACE_HAVE_SSE2
+  namespace sse2 { extern const KernelTable kernels; }
+#endif
+#ifdef GREPLACE_HAVE_AVX2
+  namespace avx2 { extern const KernelTable kernels; }
+#endif
+#ifdef GREPLACE_HAVE_AVX512
+  namespace avx512 { extern const KernelTable kernels; }
+#endif
+}
+
+#endif
@@ -0,0 +1,120 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+
+#include <string>
+
+#include "allocation.hpp"
+#include "kernels.hpp"
+
+/* Best first */
+static const greplace::KernelTable * const VARIANTS[] = {
+#ifdef GREPLACE_HAVE_AVX512
+  &greplace::avx512::kernels,
+#endif
+#ifdef GREPLACE_HAVE_AVX2
+  &greplace::avx2::kernels,
+#endif
+#ifdef GREPLACE_HAVE_SSE2
+  &greplace::sse2::kernels,
+#endif
+  &greplace::scalar::kernels
+};
+
+static bool cpu_supports(const greplace::KernelTable * table) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  std::string name = table->name;
+  if (name == "avx512") {
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw");
+  }
+  if (name == "avx2") {
+    return __builtin_cpu_supports("avx2");
+  }
+  if (name == "sse2") {
+    return __builtin_cpu_supports("sse2");
+  }
+#endif
+  return table == &greplace::scalar::kernels;
+}
+
+static const greplace::KernelTable * best_kernels(void) {
+  for (size_t i = 0; i < sizeof(VARIANTS) / sizeof(VARIANTS[0]); i ++) {
+    if (cpu_supports(VARIANTS[i])) {
+      return VARIANTS[i];
+    }
+  }
+  return &greplace::scalar::kernels;
+}
+
+static const greplace::KernelTable * forced = NULL;
+
+const greplace::KernelTable & greplace::kernels(void) {
+  static const greplace::KernelTable * best = best_kernels();
+  return forced != NULL ? *forced : *best;
+}
+
+bool greplace::use_kernels(const char * name) {
+  for (size_t i = 0; i < sizeof(VARIANTS) / sizeof(VARIANTS[0]); i ++) {
+    if (std::string(name) == VARIANTS[i]->name && cpu_supports(VARIANTS[i])) {
+      forced = VARIANTS[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+void greplace::bgr_to_grey_downscale(const cv::Mat & bgr, int factor,
+                                     cv::Mat & grey, cv::Mat & row_sums) {
+  CV_Assert(bgr.type() == CV_8UC3 && factor >= 1 && factor <= 8);
+  const greplace::KernelTable & k = greplace::kernels();
+  int rows = bgr.rows / factor;
+  int cols = bgr.cols / factor;
+  grey.create(rows, cols, CV_8UC1);
+  /* Only whole blocks are read */
+  cv::Mat sums = greplace::scratch(row_sums, cv::Size(cols * factor * 3, 1),
+                                   CV_16UC1);
+  const uchar * block[8];
+  for (int y = 0; y < rows; y ++) {
+    for (int j = 0; j < factor; j ++) {
+      block[j] = bgr.ptr<uchar>(y * factor + j);
+    }
+    k.downscale_row(block, factor, cols, sums.ptr<ushort>(0),
+                    grey.ptr<uchar>(y));
+  }
+}
+
+cv::Mat greplace::grey_histogram(const cv::Mat & grey) {
+  CV_Assert(grey.type() == CV_8UC1);
+  unsigned int bins[256] = {0};
+  greplace::kernels().histogram(grey.ptr<uchar>(0), grey.step, grey.rows,
+                                grey.cols, bins);
+  cv::Mat hist(256, 1, CV_32FC1);
+  for (int i = 0; i < 256; i ++) {
+    hist.at<float>(i) = static_cast<float>(bins[i]);
+  }
+  return hist;
+}
@@ -0,0 +1,55 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_KERNELS_HPP
+#define _GREPLACE_KERNELS_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include "kernel_table.hpp"
+
+namespace greplace {
+  /* The kernels in use: the best the CPU supports, unless use_kernels chose */
+  const greplace::KernelTable & kernels(void);
+  /*
+   * Forces one variant (scalar, sse2, avx2 or avx512). Returns false if it
+   * was not built or the CPU cannot run it. Call before starting threads.
+   */
+  bool use_kernels(const char * name);
+
+  /*
+   * Converts a BGR frame to grey and shrinks it by FACTOR in each direction,
+   * averaging FACTOR x FACTOR blocks, in one pass over the frame. Weights
+   * and rounding match cvtColor's BGR2GRAY. ROW_SUMS is a one row scratch
+   * buffer, grown as needed. Trailing rows and columns that do not fill a
+   * block are dropped.
+   */
+  void bgr_to_grey_downscale(const cv::Mat & bgr, int factor, cv::Mat & grey,
+                             cv::Mat & row_sums);
+
+  /* As calcHist with 256 bins over [0, 256): a 256 x 1 CV_32F column */
+  cv::Mat grey_histogram(const cv::Mat & grey);
+}
+
+#endif
@@ -0,0 +1,581 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * The pixel kernels, compiled once for each instruction set. Each
+ * kernels_<isa>.cpp defines GREPLACE_KERNEL_ISA and includes this file, and
+ * CMake gives it the matching -m flags; the #if ladders below then pick the
+ * widest vector code the flags allow. All variants give identical results.
+ */
+
+#ifndef GREPLACE_KERNEL_ISA
+#error "Define GREPLACE_KERNEL_ISA before including kernels_impl.hpp"
+#endif
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#if !defined(GREPLACE_KERNEL_SCALAR)
+#if defined(__AVX512BW__)
+#define KERNEL_AVX512
+#endif
+#if defined(__AVX2__)
+#define KERNEL_AVX2
+#endif
+#if defined(__SSE2__)
+#define KERNEL_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(KERNEL_AVX2) || defined(KERNEL_AVX512)
+#include <immintrin.h>
+#endif
+#endif
+
+#include "kernel_table.hpp"
+
+#define KERNEL_STRING2(x) #x
+#define KERNEL_STRING(x) KERNEL_STRING2(x)
+
+namespace greplace {
+namespace GREPLACE_KERNEL_ISA {
+
+/* cvtColor's fixed point BGR2GRAY weights, 14 fractional bits */
+static const unsigned int B_WEIGHT = 1868;
+static const unsigned int G_WEIGHT = 9617;
+static const unsigned int R_WEIGHT = 4899;
+static const int WEIGHT_SHIFT = 14;
+
+/* Adds a row of bytes into a row of 16 bit sums, or starts the sums if FIRST */
+static void accumulate_row(const uchar * src, ushort * sums, int n,
+                           bool first) {
+  int i = 0;
+#ifdef KERNEL_AVX512
+  for (; i + 32 <= n; i += 32) {
+    __m512i v = _mm512_cvtepu8_epi16(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)));
+    if (!first) {
+      v = _mm512_add_epi16(v, _mm512_loadu_si512(sums + i));
+    }
+    _mm512_storeu_si512(sums + i, v);
+  }
+#endif
+#ifdef KERNEL_AVX2
+  for (; i + 16 <= n; i += 16) {
+    __m256i v = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+    __m256i * dst = reinterpret_cast<__m256i *>(sums + i);
+    if (!first) {
+      v = _mm256_add_epi16(v, _mm256_loadu_si256(dst));
+    }
+    _mm256_storeu_si256(dst, v);
+  }
+#endif
+#ifdef KERNEL_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    __m128i * dst = reinterpret_cast<__m128i *>(sums + i);
+    if (!first) {
+      lo = _mm_add_epi16(lo, _mm_loadu_si128(dst));
+      hi = _mm_add_epi16(hi, _mm_loadu_si128(dst + 1));
+    }
+    _mm_storeu_si128(dst, lo);
+    _mm_storeu_si128(dst + 1, hi);
+  }
+#endif
+  for (; i < n; i ++) {
+    sums[i] = static_cast<ushort>(first ? src[i] : sums[i] + src[i]);
+  }
+}
+
+static void downscale_row(const uchar * const * rows, int factor, int cols,
+                          ushort * sums, uchar * dst) {
+  /* Sum the block rows down the columns, then across each block */
+  for (int k = 0; k < factor; k ++) {
+    accumulate_row(rows[k], sums, cols * factor * 3, k == 0);
+  }
+  unsigned int divisor = static_cast<unsigned int>(factor * factor) <<
+                         WEIGHT_SHIFT;
+  for (int x = 0; x < cols; x ++) {
+    const ushort * p = sums + x * factor * 3;
+    unsigned int b = 0, g = 0, r = 0;
+    for (int j = 0; j < factor; j ++) {
+      b += p[3 * j];
+      g += p[3 * j + 1];
+      r += p[3 * j + 2];
+    }
+    dst[x] = static_cast<uchar>((b * B_WEIGHT + g * G_WEIGHT + r * R_WEIGHT +
+                                 divisor / 2) / divisor);
+  }
+}
+
+/* x / 255 rounded to nearest, exact for x up to 255 * 255 */
+static inline unsigned int div255(unsigned int x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+#ifdef KERNEL_SSE2
+static inline __m128i div255_epu16(__m128i x) {
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/* Eight pixels, widened to 16 bits */
+static inline __m128i blend_epu16(__m128i s, __m128i a, __m128i d,
+                                  __m128i b) {
+  __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), a);
+  __m128i dst_weight = div255_epu16(_mm_mullo_epi16(b, inverse));
+  return _mm_add_epi16(div255_epu16(_mm_mullo_epi16(a, s)),
+                       div255_epu16(_mm_mullo_epi16(dst_weight, d)));
+}
+#endif
+
+#ifdef KERNEL_AVX2
+static inline __m256i div255_epu16(__m256i x) {
+  x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+static inline __m256i blend_epu16(__m256i s, __m256i a, __m256i d,
+                                  __m256i b) {
+  __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+  __m256i dst_weight = div255_epu16(_mm256_mullo_epi16(b, inverse));
+  return _mm256_add_epi16(div255_epu16(_mm256_mullo_epi16(a, s)),
+                          div255_epu16(_mm256_mullo_epi16(dst_weight, d)));
+}
+#endif
+
+#ifdef KERNEL_AVX512
+static inline __m512i div255_epu16(__m512i x) {
+  x = _mm512_add_epi16(x, _mm512_set1_epi16(128));
+  return _mm512_srli_epi16(_mm512_add_epi16(x, _mm512_srli_epi16(x, 8)), 8);
+}
+
+static inline __m512i blend_epu16(__m512i s, __m512i a, __m512i d,
+                                  __m512i b) {
+  __m512i inverse = _mm512_sub_epi16(_mm512_set1_epi16(255), a);
+  __m512i dst_weight = div255_epu16(_mm512_mullo_epi16(b, inverse));
+  return _mm512_add_epi16(div255_epu16(_mm512_mullo_epi16(a, s)),
+                          div255_epu16(_mm512_mullo_epi16(dst_weight, d)));
+}
+#endif
+
+static void blend_row(const uchar * s, const uchar * a, const uchar * d,
+                      const uchar * b, uchar * o, int n) {
+  int i = 0;
+  /* Unpacking works within 128 bit lanes, and packing undoes it */
+#ifdef KERNEL_AVX512
+  const __m512i zero64 = _mm512_setzero_si512();
+  const __m512i opaque64 = _mm512_set1_epi8(static_cast<char>(255));
+  for (; i + 64 <= n; i += 64) {
+    __m512i vs = _mm512_loadu_si512(s + i);
+    __m512i va = _mm512_loadu_si512(a + i);
+    __m512i vd = _mm512_loadu_si512(d + i);
+    __m512i vb = b == NULL ? opaque64 : _mm512_loadu_si512(b + i);
+    __m512i lo = blend_epu16(_mm512_unpacklo_epi8(vs, zero64),
+                             _mm512_unpacklo_epi8(va, zero64),
+                             _mm512_unpacklo_epi8(vd, zero64),
+                             _mm512_unpacklo_epi8(vb, zero64));
+    __m512i hi = blend_epu16(_mm512_unpackhi_epi8(vs, zero64),
+                             _mm512_unpackhi_epi8(va, zero64),
+                             _mm512_unpackhi_epi8(vd, zero64),
+                             _mm512_unpackhi_epi8(vb, zero64));
+    _mm512_storeu_si512(o + i, _mm512_packus_epi16(lo, hi));
+  }
+#endif
+#ifdef KERNEL_AVX2
+  const __m256i zero32 = _mm256_setzero_si256();
+  const __m256i opaque32 = _mm256_set1_epi8(static_cast<char>(255));
+  for (; i + 32 <= n; i += 32) {
+    __m256i vs = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vd = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(d + i));
+    __m256i vb = b == NULL ? opaque32 :
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    __m256i lo = blend_epu16(_mm256_unpacklo_epi8(vs, zero32),
+                             _mm256_unpacklo_epi8(va, zero32),
+                             _mm256_unpacklo_epi8(vd, zero32),
+                             _mm256_unpacklo_epi8(vb, zero32));
+    __m256i hi = blend_epu16(_mm256_unpackhi_epi8(vs, zero32),
+                             _mm256_unpackhi_epi8(va, zero32),
+                             _mm256_unpackhi_epi8(vd, zero32),
+                             _mm256_unpackhi_epi8(vb, zero32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(o + i),
+                        _mm256_packus_epi16(lo, hi));
+  }
+#endif
+#ifdef KERNEL_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i opaque = _mm_set1_epi8(static_cast<char>(255));
+  for (; i + 16 <= n; i += 16) {
+    __m128i vs = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i vd = _mm_loadu_si128(reinterpret_cast<const __m128i *>(d + i));
+    __m128i vb = b == NULL ? opaque :
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    __m128i lo = blend_epu16(_mm_unpacklo_epi8(vs, zero),
+                             _mm_unpacklo_epi8(va, zero),
+                             _mm_unpacklo_epi8(vd, zero),
+                             _mm_unpacklo_epi8(vb, zero));
+    __m128i hi = blend_epu16(_mm_unpackhi_epi8(vs, zero),
+                             _mm_unpackhi_epi8(va, zero),
+                             _mm_unpackhi_epi8(vd, zero),
+                             _mm_unpackhi_epi8(vb, zero));
+    /* Saturates, as the add at the end of alpha_compose did */
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(o + i),
+                     _mm_packus_epi16(lo, hi));
+  }
+#endif
+  for (; i < n; i ++) {
+    unsigned int dst_weight = b == NULL ? 255 - a[i] :
+                                          div255(b[i] * (255u - a[i]));
+    unsigned int v = div255(a[i] * s[i]) + div255(dst_weight * d[i]);
+    o[i] = static_cast<uchar>(v > 255 ? 255 : v);
+  }
+}
+
+/* Pixels whose distance from the centre is worked out at once */
+static const int MASK_BLOCK = 64;
+
+static void alpha_mask_row(double dr, double centre_col, double max_dist,
+                           double r0, double rf, bool reverse, uchar * dst,
+                           int cols) {
+  double ratios[MASK_BLOCK];
+  double mf = 255 / (rf - r0);
+  for (int start = 0; start < cols; start += MASK_BLOCK) {
+    int n = cols - start < MASK_BLOCK ? cols - start : MASK_BLOCK;
+    int i = 0;
+    /* sqrt and division are exactly rounded, so every width agrees */
+#ifdef KERNEL_AVX512
+    for (; i + 8 <= n; i += 8) {
+      __m512d dc = _mm512_sub_pd(
+          _mm512_set_pd(start + i + 7, start + i + 6, start + i + 5,
+                        start + i + 4, start + i + 3, start + i + 2,
+                        start + i + 1, start + i),
+          _mm512_set1_pd(centre_col));
+      __m512d d2 = _mm512_add_pd(_mm512_set1_pd(dr * dr),
+                                 _mm512_mul_pd(dc, dc));
+      _mm512_storeu_pd(ratios + i, _mm512_div_pd(_mm512_sqrt_pd(d2),
+                                                 _mm512_set1_pd(max_dist)));
+    }
+#endif
+#ifdef KERNEL_AVX2
+    for (; i + 4 <= n; i += 4) {
+      __m256d dc = _mm256_sub_pd(
+          _mm256_set_pd(start + i + 3, start + i + 2, start + i + 1,
+                        start + i),
+          _mm256_set1_pd(centre_col));
+      __m256d d2 = _mm256_add_pd(_mm256_set1_pd(dr * dr),
+                                 _mm256_mul_pd(dc, dc));
+      _mm256_storeu_pd(ratios + i, _mm256_div_pd(_mm256_sqrt_pd(d2),
+                                                 _mm256_set1_pd(max_dist)));
+    }
+#endif
+#ifdef KERNEL_SSE2
+    for (; i + 2 <= n; i += 2) {
+      __m128d dc = _mm_sub_pd(_mm_set_pd(start + i + 1, start + i),
+                              _mm_set1_pd(centre_col));
+      __m128d d2 = _mm_add_pd(_mm_set1_pd(dr * dr), _mm_mul_pd(dc, dc));
+      _mm_storeu_pd(ratios + i, _mm_div_pd(_mm_sqrt_pd(d2),
+                                           _mm_set1_pd(max_dist)));
+    }
+#endif
+    for (; i < n; i ++) {
+      double dc = start + i - centre_col;
+      ratios[i] = sqrt(dr * dr + dc * dc) / max_dist;
+    }
+    for (i = 0; i < n; i ++) {
+      double ratio = ratios[i];
+      int alpha;
+      if (reverse) {
+        alpha = 0;
+        if (ratio >= r0) {
+          alpha = mf * (ratio - r0);
+        }
+        if (ratio >= rf) {
+          alpha = 255;
+        }
+      } else {
+        alpha = 255;
+        if (ratio >= r0) {
+          alpha = 255 - mf * (ratio - r0);
+        }
+        if (ratio >= rf) {
+          alpha = 0;
+        }
+      }
+      dst[start + i] = static_cast<uchar>(alpha);
+    }
+  }
+}
+
+static void histogram(const uchar * data, size_t step, int rows, int cols,
+                      unsigned int * bins) {
+  /* Four partial histograms, so repeated values do not stall on one bin */
+  unsigned int partial[4][256];
+  memset(partial, 0, sizeof(partial));
+  for (int y = 0; y < rows; y ++) {
+    const uchar * p = data + y * step;
+    int x = 0;
+    for (; x + 4 <= cols; x += 4) {
+      partial[0][p[x]]++;
+      partial[1][p[x + 1]]++;
+      partial[2][p[x + 2]]++;
+      partial[3][p[x + 3]]++;
+    }
+    for (; x < cols; x ++) {
+      partial[0][p[x]]++;
+    }
+  }
+  for (int i = 0; i < 256; i ++) {
+    bins[i] += partial[0][i] + partial[1][i] + partial[2][i] + partial[3][i];
+  }
+}
+
+/*
+ * Haar cascade windows. Sums and thresholds follow OpenCV 2.4's
+ * cvRunHaarClassifierCascadeSum (its SSE2 build) operation for operation:
+ * a two rectangle stage adds its weighted sums in float, any other in
+ * double, and a stump takes its left value when the sum is below the
+ * threshold scaled by the window's standard deviation. The vector paths
+ * run one window per lane and stop once every lane has been rejected.
+ */
+static inline int rect_sum(const int * p, const int * corners) {
+  return p[corners[0]] - p[corners[1]] - p[corners[2]] + p[corners[3]];
+}
+
+/* The window's standard deviation, or 1 for a negative variance */
+static inline double window_norm(const HaarScaledCascade & cascade,
+                                 const int * sum, const double * sqsum,
+                                 int offset) {
+  const int * w = cascade.window;
+  double mean = rect_sum(sum + offset, w) * cascade.inv_window_area;
+  const double * q = sqsum + offset;
+  double norm = q[w[0]] - q[w[1]] - q[w[2]] + q[w[3]];
+  norm = norm * cascade.inv_window_area - mean * mean;
+  return norm >= 0. ? sqrt(norm) : 1.;
+}
+
+static int haar_window(const HaarScaledCascade & cascade, const int * sum,
+                       const double * sqsum, int offset) {
+  double norm = window_norm(cascade, sum, sqsum, offset);
+  const int * p = sum + offset;
+  for (int i = 0; i < cascade.stage_count; i ++) {
+    const HaarScaledStage & stage = cascade.stages[i];
+    const HaarScaledStump * stump = cascade.stumps + stage.first;
+    double stage_sum = 0.0;
+    for (int j = 0; j < stage.count; j ++, stump ++) {
+      double t = stump->threshold * norm;
+      double value;
+      if (stage.two_rects) {
+        value = rect_sum(p, stump->corners[0]) * stump->weights[0] +
+                rect_sum(p, stump->corners[1]) * stump->weights[1];
+      } else {
+        value = rect_sum(p, stump->corners[0]) * stump->weights[0];
+        value += rect_sum(p, stump->corners[1]) * stump->weights[1];
+        if (stump->rect_count > 2) {
+          value += rect_sum(p, stump->corners[2]) * stump->weights[2];
+        }
+      }
+      stage_sum += value < t ? stump->left : stump->right;
+    }
+    if (stage_sum < stage.threshold) {
+      return -i;
+    }
+  }
+  return 1;
+}
+
+#ifdef KERNEL_AVX2
+static inline __m128i rect_sums4(const int * sum, const int * corners,
+                                 __m128i offsets) {
+  __m128i a = _mm_i32gather_epi32(sum + corners[0], offsets, 4);
+  __m128i b = _mm_i32gather_epi32(sum + corners[1], offsets, 4);
+  __m128i c = _mm_i32gather_epi32(sum + corners[2], offsets, 4);
+  __m128i d = _mm_i32gather_epi32(sum + corners[3], offsets, 4);
+  return _mm_add_epi32(_mm_sub_epi32(_mm_sub_epi32(a, b), c), d);
+}
+
+static inline __m128 weighted4(const int * sum, const HaarScaledStump * stump,
+                               int k, __m128i offsets) {
+  return _mm_mul_ps(_mm_cvtepi32_ps(rect_sums4(sum, stump->corners[k],
+                                               offsets)),
+                    _mm_set1_ps(stump->weights[k]));
+}
+
+/* LANES (up to 4) windows from OFFSETS */
+static void haar_windows4(const HaarScaledCascade & cascade, const int * sum,
+                          const double * sqsum, const int * offsets, int lanes,
+                          int * results) {
+  int o[4];
+  double n[4];
+  for (int k = 0; k < 4; k ++) {
+    o[k] = offsets[k < lanes ? k : 0];
+    n[k] = window_norm(cascade, sum, sqsum, o[k]);
+  }
+  for (int k = 0; k < lanes; k ++) {
+    results[k] = 1;
+  }
+  __m128i vo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(o));
+  __m256d norm = _mm256_loadu_pd(n);
+  int alive = (1 << lanes) - 1;
+  for (int i = 0; i < cascade.stage_count && alive != 0; i ++) {
+    const HaarScaledStage & stage = cascade.stages[i];
+    const HaarScaledStump * stump = cascade.stumps + stage.first;
+    __m256d stage_sum = _mm256_setzero_pd();
+    for (int j = 0; j < stage.count; j ++, stump ++) {
+      __m256d t = _mm256_mul_pd(_mm256_set1_pd(stump->threshold), norm);
+      __m128 f0 = weighted4(sum, stump, 0, vo);
+      __m128 f1 = weighted4(sum, stump, 1, vo);
+      __m256d value;
+      if (stage.two_rects) {
+        value = _mm256_cvtps_pd(_mm_add_ps(f0, f1));
+      } else {
+        value = _mm256_add_pd(_mm256_cvtps_pd(f0), _mm256_cvtps_pd(f1));
+        if (stump->rect_count > 2) {
+          value = _mm256_add_pd(value,
+                                _mm256_cvtps_pd(weighted4(sum, stump, 2, vo)));
+        }
+      }
+      __m256d below = _mm256_cmp_pd(value, t, _CMP_LT_OQ);
+      stage_sum = _mm256_add_pd(stage_sum,
+                                _mm256_blendv_pd(_mm256_set1_pd(stump->right),
+                                                 _mm256_set1_pd(stump->left),
+                                                 below));
+    }
+    int rejected = _mm256_movemask_pd(
+        _mm256_cmp_pd(stage_sum, _mm256_set1_pd(stage.threshold),
+                      _CMP_LT_OQ)) & alive;
+    for (int k = 0; k < lanes; k ++) {
+      if (rejected & (1 << k)) {
+        results[k] = -i;
+      }
+    }
+    alive &= ~rejected;
+  }
+}
+#endif
+
+#ifdef KERNEL_AVX512
+static inline __m256i rect_sums8(const int * sum, const int * corners,
+                                 __m256i offsets) {
+  __m256i a = _mm256_i32gather_epi32(sum + corners[0], offsets, 4);
+  __m256i b = _mm256_i32gather_epi32(sum + corners[1], offsets, 4);
+  __m256i c = _mm256_i32gather_epi32(sum + corners[2], offsets, 4);
+  __m256i d = _mm256_i32gather_epi32(sum + corners[3], offsets, 4);
+  return _mm256_add_epi32(_mm256_sub_epi32(_mm256_sub_epi32(a, b), c), d);
+}
+
+static inline __m256 weighted8(const int * sum, const HaarScaledStump * stump,
+                               int k, __m256i offsets) {
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(rect_sums8(sum, stump->corners[k],
+                                                     offsets)),
+                       _mm256_set1_ps(stump->weights[k]));
+}
+
+/* Eight windows from OFFSETS */
+static void haar_windows8(const HaarScaledCascade & cascade, const int * sum,
+                          const double * sqsum, const int * offsets,
+                          int * results) {
+  double n[8];
+  for (int k = 0; k < 8; k ++) {
+    n[k] = window_norm(cascade, sum, sqsum, offsets[k]);
+    results[k] = 1;
+  }
+  __m256i vo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offsets));
+  __m512d norm = _mm512_loadu_pd(n);
+  __mmask8 alive = 0xff;
+  for (int i = 0; i < cascade.stage_count && alive != 0; i ++) {
+    const HaarScaledStage & stage = cascade.stages[i];
+    const HaarScaledStump * stump = cascade.stumps + stage.first;
+    __m512d stage_sum = _mm512_setzero_pd();
+    for (int j = 0; j < stage.count; j ++, stump ++) {
+      __m512d t = _mm512_mul_pd(_mm512_set1_pd(stump->threshold), norm);
+      __m256 f0 = weighted8(sum, stump, 0, vo);
+      __m256 f1 = weighted8(sum, stump, 1, vo);
+      __m512d value;
+      if (stage.two_rects) {
+        value = _mm512_cvtps_pd(_mm256_add_ps(f0, f1));
+      } else {
+        value = _mm512_add_pd(_mm512_cvtps_pd(f0), _mm512_cvtps_pd(f1));
+        if (stump->rect_count > 2) {
+          value = _mm512_add_pd(value,
+                                _mm512_cvtps_pd(weighted8(sum, stump, 2, vo)));
+        }
+      }
+      __mmask8 below = _mm512_cmp_pd_mask(value, t, _CMP_LT_OQ);
+      stage_sum = _mm512_add_pd(stage_sum,
+                                _mm512_mask_blend_pd(below,
+                                    _mm512_set1_pd(stump->right),
+                                    _mm512_set1_pd(stump->left)));
+    }
+    __mmask8 rejected = _mm512_cmp_pd_mask(stage_sum,
+                                           _mm512_set1_pd(stage.threshold),
+                                           _CMP_LT_OQ) & alive;
+    for (int k = 0; k < 8; k ++) {
+      if (rejected & (1 << k)) {
+        results[k] = -i;
+      }
+    }
+    alive &= ~rejected;
+  }
+}
+#endif
+
+static void haar_windows(const HaarScaledCascade & cascade, const int * sum,
+                         const double * sqsum, const int * offsets, int count,
+                         int * results) {
+  int i = 0;
+#ifdef KERNEL_AVX512
+  for (; i + 8 <= count; i += 8) {
+    haar_windows8(cascade, sum, sqsum, offsets + i, results + i);
+  }
+#endif
+#ifdef KERNEL_AVX2
+  for (; i < count; i += 4) {
+    haar_windows4(cascade, sum, sqsum, offsets + i,
+                  count - i < 4 ? count - i : 4, results + i);
+  }
+#endif
+  /* SSE2 has no gathers, so it takes one window at a time like scalar */
+  for (; i < count; i ++) {
+    results[i] = haar_window(cascade, sum, sqsum, offsets[i]);
+  }
+}
+
+extern const KernelTable kernels = {
+  KERNEL_STRING(GREPLACE_KERNEL_ISA),
+  downscale_row,
+  blend_row,
+  alpha_mask_row,
+  histogram,
+  haar_windows
+};
+
+}
+}
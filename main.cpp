@@ -44,7 +44,17 @@
 #include <getopt.h>
 
 #include "person.hpp"
+#include "capture.hpp"
 #include "cpu.hpp"
+#include "options.hpp"
+#include "pipeline.hpp"
+#include "frame_parallel.hpp"
+#include "sink.hpp"
+#include "display.hpp"
+#include "detector.hpp"
+#include "cascade_cache.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
 #include "cmake_config.h"
 
 #ifdef HAVE_CUDA
@@ -57,18 +67,53 @@ static const struct option longOpts[] = {
   {"x_res",       required_argument, NULL, 'x'},
   {"y_res",       required_argument, NULL, 'y'},
   {"webcam",      required_argument, NULL, 'w'},
+  {"input",       required_argument, NULL, 'i'},
+  {"output",      required_argument, NULL, 'o'},
+  {"output_format", required_argument, NULL, 'f'},
+  {"output_queue", required_argument, NULL, 'b'},
+  {"headless",    no_argument,       NULL, 'H'},
   {"cuda_device", required_argument, NULL, 'g'},
   {"cpu",         no_argument,       NULL, 'c'},
+  {"pipeline",    no_argument,       NULL, 'p'},
+  {"queue_depth", required_argument, NULL, 'q'},
+  {"workers",     required_argument, NULL, 'j'},
+  {"check_allocations", no_argument, NULL, 'A'},
+  {"detect_every", required_argument, NULL, 'n'},
+  {"track_confidence", required_argument, NULL, 'k'},
+  {"full_scan_every", required_argument, NULL, 'F'},
+  {"detect_scale", required_argument, NULL, 'd'},
+  {"smoothing",   required_argument, NULL, 's'},
+  {"colour",      no_argument,       NULL, 'C'},
+  {"tile_threads", required_argument, NULL, 't'},
+  {"isa",         required_argument, NULL, 'I'},
+  {"detector",    required_argument, NULL, 'E'},
+  {"cascade",     required_argument, NULL, 'K'},
+  {"native_haar", no_argument,       NULL, 'N'},
+  {"cache_cascade", required_argument, NULL, 'W'},
+  {"detect_threads", required_argument, NULL, 'D'},
+  {"motion_threshold", required_argument, NULL, 'M'},
+  {"idle_after",  required_argument, NULL, 'L'},
+  {"idle_every",  required_argument, NULL, 'P'},
+  {"max_faces",   required_argument, NULL, 'm'},
   {"help",        no_argument,       NULL, 'h'},
   {"usage",       no_argument,       NULL, 'h'},
-  {"verbose",     no_argument,       NULL, 'v'}
+  {"verbose",     no_argument,       NULL, 'v'},
+  {NULL,          0,                 NULL, 0}
 };
 
 const int THRESHOLDING_FACTOR = 16;
 const int INTERPERSON_PERIOD  = 1000;
+const int DEFAULT_QUEUE_DEPTH = 4;
+const int DEFAULT_OUTPUT_QUEUE_DEPTH = 8;
+const double DEFAULT_OUTPUT_FPS = 30;
+const double DEFAULT_TRACK_CONFIDENCE = 0.6;
+const int DEFAULT_FULL_SCAN_PERIOD = 10;
+const double DEFAULT_IDLE_AFTER = 10.0;
+const int DEFAULT_IDLE_PERIOD = 30;
 
 const char * FACES_LOAD_DIRECTORY = "\\parameter_faces";
 const char * HAAR_CASCADE_FRONTAL_FACE_LOCATION = "haarcascade_frontalface_default.xml";
+const char * LBP_CASCADE_FRONTAL_FACE_LOCATION = "lbpcascade_frontalface.xml";
 const char * MAIN_WINDOW_TITLE = "greplace";
 
 void display_help(void) {
@@ -85,12 +130,128 @@ void display_help(void) {
   std::cout << "    -w, --webcam"                                 << std::endl;
   std::cout << "        Sets the webcam to use."                  << std::endl;
   std::cout << "        Defaults to 0."                           << std::endl;
+  std::cout << "    -i, --input"                                  << std::endl;
+  std::cout << "        Reads a video file or a numbered image sequence ";
+  std::cout << "(e.g. frame_%04d.png) instead of the webcam. Runs without ";
+  std::cout << "a window or frame pacing and reports the total frame rate ";
+  std::cout << "at the end. .y4m files, and - for a Y4M stream on stdin, ";
+  std::cout << "and .yuv files of I420 at --x_res by --y_res are read ";
+  std::cout << "straight into the grey plane without decoding to colour.";
+  std::cout << std::endl;
+  std::cout << "    -o, --output"                                 << std::endl;
+  std::cout << "        Also writes the processed frames to this file or ";
+  std::cout << "named pipe. Use - for stdout."                    << std::endl;
+  std::cout << "    -f, --output_format"                          << std::endl;
+  std::cout << "        One of video, raw (bare grey frames, or BGR with ";
+  std::cout << "--colour) or y4m. Defaults to a guess from the output ";
+  std::cout << "name."                                            << std::endl;
+  std::cout << "    -b, --output_queue"                           << std::endl;
+  std::cout << "        Sets the number of frames that may wait for the ";
+  std::cout << "output encoder before frames are dropped. Defaults to 8.";
+  std::cout << std::endl;
+  std::cout << "    -H, --headless"                               << std::endl;
+  std::cout << "        Runs without a window."                   << std::endl;
   std::cout << "    -g, --cuda_device"                            << std::endl;
   std::cout << "        Sets the CUDA device to use."             << std::endl;
   std::cout << "        Defaults to 0."                           << std::endl;
   std::cout << "    -c, --cpu"                                    << std::endl;
   std::cout << "        Runs greplace on the CPU. If greplace was compiled ";
   std::cout << "without CUDA, greplace is always run on the CPU." << std::endl;
+  std::cout << "    -p, --pipeline"                               << std::endl;
+  std::cout << "        Runs capture, detection, recognition and output ";
+  std::cout << "on separate threads."                             << std::endl;
+  std::cout << "    -q, --queue_depth"                            << std::endl;
+  std::cout << "        Sets the number of frames buffered between ";
+  std::cout << "pipeline stages. Defaults to 4."                  << std::endl;
+  std::cout << "    -j, --workers"                                << std::endl;
+  std::cout << "        Processes this many frames at once, one per ";
+  std::cout << "worker thread, and displays them in capture order. ";
+  std::cout << "Overrides --pipeline. Defaults to 0 (off)."       << std::endl;
+  std::cout << "    -A, --check_allocations"                      << std::endl;
+  std::cout << "        Aborts if the serial loop allocates an image after ";
+  std::cout << "its first few frames, other than the face samples ";
+  std::cout << "kept for training while its gallery fills."       << std::endl;
+  std::cout << "    -n, --detect_every"                           << std::endl;
+  std::cout << "        Runs the face detector on every nth frame and ";
+  std::cout << "tracks the face in between. Not used with --workers. ";
+  std::cout << "Defaults to 1 (detect on every frame)."           << std::endl;
+  std::cout << "    -k, --track_confidence"                       << std::endl;
+  std::cout << "        Sets the match score, from -1 to 1, below which ";
+  std::cout << "the tracker gives up and the detector runs early. ";
+  std::cout << "Defaults to 0.6."                                 << std::endl;
+  std::cout << "    -F, --full_scan_every"                        << std::endl;
+  std::cout << "        While a face is known, the detector only searches ";
+  std::cout << "near it, and scans the whole frame on every nth run to ";
+  std::cout << "find new faces. 1 always scans the whole frame. Not used ";
+  std::cout << "with --workers. Defaults to 10."                  << std::endl;
+  std::cout << "    -d, --detect_scale"                           << std::endl;
+  std::cout << "        Runs the face detector on the frame shrunk by ";
+  std::cout << "this factor, from 1 to 8. Faces large enough to replace ";
+  std::cout << "are still found at 2 or 4. Defaults to 1."        << std::endl;
+  std::cout << "    -s, --smoothing"                              << std::endl;
+  std::cout << "        How the seam around a replaced face is hidden. ";
+  std::cout << "frame blurs the whole frame, seam blurs only a band ";
+  std::cout << "along the seam, and seam_box also runs a light filter ";
+  std::cout << "over the rest of the frame. Defaults to frame."   << std::endl;
+  std::cout << "    -C, --colour"                                 << std::endl;
+  std::cout << "        Outputs colour instead of grey. The replacement is ";
+  std::cout << "drawn and smoothed on the brightness only, and the face ";
+  std::cout << "takes the average colour of the one it covers." << std::endl;
+  std::cout << "    -t, --tile_threads"                           << std::endl;
+  std::cout << "        Composes each frame in cache sized bands of rows, ";
+  std::cout << "shared between this many threads, instead of a stage at a ";
+  std::cout << "time. Only frame smoothing is tiled, but the threads also ";
+  std::cout << "draw several faces at once. Defaults to 0 (off).";
+  std::cout << std::endl;
+  std::cout << "    -I, --isa"                                    << std::endl;
+  std::cout << "        Forces the pixel kernels built for one instruction ";
+  std::cout << "set: scalar, sse2, avx2 or avx512. Defaults to the best ";
+  std::cout << "this CPU supports."                               << std::endl;
+  std::cout << "    -E, --detector"                               << std::endl;
+  std::cout << "        The face detector: haar (OpenCV's Haar cascade), ";
+  std::cout << "native (greplace's own evaluator of the same cascade, ";
+  std::cout << "which checks several windows at once with the pixel ";
+  std::cout << "kernels and finds the same faces) or lbp (OpenCV's LBP ";
+  std::cout << "cascade, several times faster on CPU but a little less ";
+  std::cout << "accurate). Defaults to haar."                     << std::endl;
+  std::cout << "    -K, --cascade"                                << std::endl;
+  std::cout << "        The cascade XML file. Defaults to ";
+  std::cout << HAAR_CASCADE_FRONTAL_FACE_LOCATION << ", or ";
+  std::cout << LBP_CASCADE_FRONTAL_FACE_LOCATION << " for lbp. The ";
+  std::cout << "native detector has the default built in, and keeps ";
+  std::cout << "others in a binary .cache file beside the XML, or under ";
+  std::cout << "~/.cache/greplace if that directory is read only, so no ";
+  std::cout << "XML is parsed at startup."                        << std::endl;
+  std::cout << "    -W, --cache_cascade"                          << std::endl;
+  std::cout << "        Writes the .cache file for this cascade XML and ";
+  std::cout << "exits, for installing a cascade where greplace itself ";
+  std::cout << "cannot write."                                    << std::endl;
+  std::cout << "    -N, --native_haar"                            << std::endl;
+  std::cout << "        The same as --detector native."           << std::endl;
+  std::cout << "    -D, --detect_threads"                         << std::endl;
+  std::cout << "        Shares each detection's scales and bands of rows ";
+  std::cout << "between this many threads. Only the native detector can, ";
+  std::cout << "so this picks it unless another is asked for. Defaults ";
+  std::cout << "to 0 (the calling thread only)."                  << std::endl;
+  std::cout << "    -M, --motion_threshold"                       << std::endl;
+  std::cout << "        Skips detection, keeping the last face, on frames ";
+  std::cout << "whose grey level has changed by less than this on average ";
+  std::cout << "since the last detection, measured on a copy shrunk 8 ";
+  std::cout << "times. 2 to 4 ignores sensor noise. Not used with ";
+  std::cout << "--workers. Defaults to 0 (detect on every frame)." << std::endl;
+  std::cout << "    -L, --idle_after"                             << std::endl;
+  std::cout << "        With --motion_threshold, the seconds without a ";
+  std::cout << "face or any motion before detection backs off to ";
+  std::cout << "--idle_every. Motion returns to the full rate at once. ";
+  std::cout << "Defaults to 10."                                  << std::endl;
+  std::cout << "    -P, --idle_every"                             << std::endl;
+  std::cout << "        Once backed off, runs the detector on at most every ";
+  std::cout << "nth frame. Defaults to 30."                       << std::endl;
+  std::cout << "    -m, --max_faces"                              << std::endl;
+  std::cout << "        Replaces up to this many faces in each frame, ";
+  std::cout << "largest first, recognising them together. Above 1, ";
+  std::cout << "--detect_every and --full_scan_every are not used. ";
+  std::cout << "Defaults to 1."                                   << std::endl;
   std::cout << "    -v, --verbose"                                << std::endl;
   std::cout << "        Makes greplace output additional ";
   std::cout << "information."                                     << std::endl;
@@ -101,7 +262,9 @@ void display_help(void) {
 
 void get_options(int argc, char ** argv, int & x_res, int & y_res,
                  int & video_capture, int & cuda_device, bool & gpu,
-                 bool & verbosity) {
+                 bool & verbosity, const char * & output,
+                 const char * & output_format, int & output_queue,
+                 greplace::Options & options) {
   int optIndex[1];
   int opt;
 
@@ -121,12 +284,111 @@ void get_options(int argc, char ** argv, int & x_res, int & y_res,
     case 'g':
 			cuda_device = atoi(optarg);
       break;
+    case 'p':
+      options.pipelined = true;
+      break;
+    case 'q':
+			options.queue_depth = atoi(optarg);
+      break;
+    case 'j':
+			options.workers = atoi(optarg);
+      break;
+    case 'A':
+      options.check_allocations = true;
+      break;
+    case 'n':
+			options.detect_period = atoi(optarg);
+      break;
+    case 'k':
+			options.track_confidence = atof(optarg);
+      break;
+    case 'F':
+			options.full_scan_period = atoi(optarg);
+      break;
+    case 'd':
+			options.detect_scale = atoi(optarg);
+      break;
+    case 'C':
+      options.colour = true;
+      break;
+    case 't':
+			options.tile_threads = atoi(optarg);
+      break;
+    case 'I':
+      if (!greplace::use_kernels(optarg)) {
+        std::cout << "greplace: " << optarg << " kernels are not available ";
+        std::cout << "in this build or on this CPU." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'E':
+      if (std::string(optarg) == "haar") {
+        options.detector = greplace::DETECT_HAAR;
+      } else if (std::string(optarg) == "native") {
+        options.detector = greplace::DETECT_NATIVE_HAAR;
+      } else if (std::string(optarg) == "lbp") {
+        options.detector = greplace::DETECT_LBP;
+      } else {
+        display_help();
+      }
+      break;
+    case 'K':
+      options.classifier_config = optarg;
+      break;
+    case 'N':
+      options.detector = greplace::DETECT_NATIVE_HAAR;
+      break;
+    case 'W':
+      exit(greplace::write_cascade_cache(optarg) ? EXIT_SUCCESS :
+                                                    EXIT_FAILURE);
+    case 'D':
+			options.detect_threads = atoi(optarg);
+      break;
+    case 'M':
+			options.motion_threshold = atof(optarg);
+      break;
+    case 'L':
+			options.idle_after = atof(optarg);
+      break;
+    case 'P':
+			options.idle_period = atoi(optarg);
+      break;
+    case 'm':
+			options.max_faces = atoi(optarg);
+      break;
+    case 's':
+      if (std::string(optarg) == "frame") {
+        options.smoothing = greplace::SMOOTH_FRAME;
+      } else if (std::string(optarg) == "seam") {
+        options.smoothing = greplace::SMOOTH_SEAM;
+      } else if (std::string(optarg) == "seam_box") {
+        options.smoothing = greplace::SMOOTH_SEAM_BOX;
+      } else {
+        display_help();
+      }
+      break;
     case 'v':
       verbosity = true;
       break;
     case 'w':
 			video_capture = atoi(optarg);
       break;
+    case 'i':
+      options.input = optarg;
+      options.headless = true;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'f':
+      output_format = optarg;
+      break;
+    case 'b':
+			output_queue = atoi(optarg);
+      break;
+    case 'H':
+      options.headless = true;
+      break;
     case 'h':
       display_help();
     default:
@@ -137,26 +399,116 @@ void get_options(int argc, char ** argv, int & x_res, int & y_res,
 
 
 int main(int argc, char ** argv) {
-  int x_res = 1280, y_res = 720, video_capture = 0, cuda_device = 0, threshold;
+  int x_res = 1280, y_res = 720, video_capture = 0, cuda_device = 0;
+  int output_queue = DEFAULT_OUTPUT_QUEUE_DEPTH;
   bool verbose = false, gpu = true;
+  const char * output = NULL, * output_format = NULL;
+  greplace::Options options;
+  options.interperson_period = INTERPERSON_PERIOD;
+  options.queue_depth = DEFAULT_QUEUE_DEPTH;
+  options.track_confidence = DEFAULT_TRACK_CONFIDENCE;
+  options.full_scan_period = DEFAULT_FULL_SCAN_PERIOD;
+  options.idle_after = DEFAULT_IDLE_AFTER;
+  options.idle_period = DEFAULT_IDLE_PERIOD;
   get_options(argc, argv, x_res, y_res, video_capture, cuda_device, gpu,
-              verbose);
+              verbose, output, output_format, output_queue, options);
+  if (options.classifier_config == NULL) {
+    options.classifier_config = options.detector == greplace::DETECT_LBP ?
+                                LBP_CASCADE_FRONTAL_FACE_LOCATION :
+                                HAAR_CASCADE_FRONTAL_FACE_LOCATION;
+  }
+  if (verbose) {
+    std::cout << "greplace: Using " << greplace::kernels().name;
+    std::cout << " kernels" << std::endl;
+  }
+  if (options.detect_scale < 1 || options.detect_scale > 8) {
+    std::cout << "greplace: --detect_scale must be from 1 to 8." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (options.max_faces < 1) {
+    std::cout << "greplace: --max_faces must be at least 1." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (options.tile_threads > 0) {
+    options.tiles = new greplace::WorkerPool(options.tile_threads);
+  }
+  if (options.detect_threads > 0) {
+    if (options.detector == greplace::DETECT_LBP) {
+      std::cout << "greplace: --detect_threads needs the native detector.";
+      std::cout << std::endl;
+      return EXIT_FAILURE;
+    }
+    options.detector = greplace::DETECT_NATIVE_HAAR;
+    options.detections = new greplace::WorkerPool(options.detect_threads);
+  }
   if ((HAVE_CUDA == false) && (gpu = true)) {
     std::cout << "greplace was compiled without CUDA support. Proceeding on ";
     std::cout << "CPU." << std::endl;
   }
-  threshold = x_res * y_res / THRESHOLDING_FACTOR;
-  cv::VideoCapture webcam(video_capture);
-	webcam.set(CV_CAP_PROP_FRAME_WIDTH,  x_res);
-	webcam.set(CV_CAP_PROP_FRAME_HEIGHT, y_res);
-  cv::namedWindow(MAIN_WINDOW_TITLE, CV_WINDOW_AUTOSIZE );
+  greplace::Capture * capture = greplace::create_capture(
+      options.input, video_capture, cv::Size(x_res, y_res));
+  if (capture == NULL) {
+    return EXIT_FAILURE;
+  }
+  x_res = capture->size().width;
+  y_res = capture->size().height;
+  if (options.colour && !capture->colour()) {
+    std::cout << "greplace: --colour needs a colour input." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (output != NULL) {
+    double fps = capture->fps();
+    if (fps <= 0) {
+      fps = DEFAULT_OUTPUT_FPS;
+    }
+    options.sink = new greplace::AsyncSink(greplace::create_sink(output,
+                                                                 output_format,
+                                                                 fps),
+                                           output_queue);
+    /* Saves compose converting to BGR only for the sink to convert back */
+    options.ycrcb_output = options.colour && options.sink->takes_ycrcb();
+  }
+  if (!options.headless) {
+    options.display = new greplace::Display(MAIN_WINDOW_TITLE,
+                                            options.ycrcb_output);
+  }
+  options.threshold = x_res * y_res / THRESHOLDING_FACTOR;
   cv::Ptr<cv::FaceRecognizer> model = cv::createFisherFaceRecognizer();
   greplace::Person previous_person = greplace::Person(std::string(FACES_LOAD_DIRECTORY),
                                           x_res, y_res);
   previous_person.train_model(model);
-    cv::CascadeClassifier classifier = greplace::init(HAAR_CASCADE_FRONTAL_FACE_LOCATION);
-    greplace::main_loop(webcam, classifier, model, previous_person, threshold,
-                        INTERPERSON_PERIOD, MAIN_WINDOW_TITLE);
-
-  return EXIT_FAILURE;
+  bool finished;
+  if (options.workers > 0) {
+    finished = greplace::frame_parallel_main_loop(*capture, model,
+                                                  previous_person, options);
+  } else {
+    greplace::Detector * detector = greplace::create_detector(
+        options.detector, options.classifier_config, options.detections);
+    if (detector == NULL) {
+      return EXIT_FAILURE;
+    }
+    if (options.pipelined) {
+      finished = greplace::pipelined_main_loop(*capture, *detector, model,
+                                               previous_person, options);
+    } else {
+      finished = greplace::main_loop(*capture, *detector, model,
+                                     previous_person, options);
+    }
+    delete detector;
+  }
+  /* Waits for the encoder to catch up */
+  delete options.sink;
+  delete options.display;
+  delete options.tiles;
+  delete options.detections;
+  delete capture;
+  if (greplace::exit_requested) {
+    std::cout << std::endl << "greplace: User entered kill signal" << std::endl;
+    return EXIT_SUCCESS;
+  }
+  if (!finished) {
+    std::cout << "greplace: Unexpected exit." << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
 }
@@ -0,0 +1,116 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_OPTIONS_HPP
+#define _GREPLACE_OPTIONS_HPP
+
+#include <stddef.h>
+
+namespace greplace {
+  class Sink;
+  class Display;
+  class WorkerPool;
+
+  /* Which face detector the main loops run */
+  enum DetectorBackend {
+    /* OpenCV's Haar cascade */
+    DETECT_HAAR,
+    /* greplace's SIMD evaluator of the same Haar cascade */
+    DETECT_NATIVE_HAAR,
+    /* OpenCV's LBP cascade: integer features, several times faster */
+    DETECT_LBP
+  };
+
+  /* How compose hides the seam around a replaced face */
+  enum Smoothing {
+    /* A 9x9 Gaussian blur over the whole frame */
+    SMOOTH_FRAME,
+    /* The same blur, but only in a band along the seam */
+    SMOOTH_SEAM,
+    /* The seam band, and a 3x3 box filter over the rest of the frame */
+    SMOOTH_SEAM_BOX
+  };
+
+  /* Settings shared by the main loop variants, filled in from the command line */
+  struct Options {
+    Options(void)
+      : threshold(0), interperson_period(0), classifier_config(NULL),
+        input(NULL), headless(false), pipelined(false), queue_depth(0),
+        workers(0), check_allocations(false), detect_period(1),
+        track_confidence(0.0), full_scan_period(1), detect_scale(1),
+        motion_threshold(0.0), idle_after(0.0), idle_period(1), max_faces(1),
+        smoothing(SMOOTH_FRAME), colour(false), ycrcb_output(false),
+        tile_threads(0), tiles(NULL),
+        detector(DETECT_HAAR), detect_threads(0), detections(NULL), sink(NULL),
+        display(NULL) { }
+    int threshold;
+    int interperson_period;
+    const char * classifier_config;
+    /* Video file or numbered image sequence to read instead of the webcam */
+    const char * input;
+    /* No window and no frame pacing; frames are processed as fast as possible */
+    bool headless;
+    bool pipelined;
+    int queue_depth;
+    int workers;
+    /* Abort if the serial loop allocates an image once it has warmed up */
+    bool check_allocations;
+    /* Frames between cascade runs; the tracker follows the face in between */
+    int detect_period;
+    /* Template match score below which the tracker asks for a detection */
+    double track_confidence;
+    /* Frames between whole frame scans while a face is being followed */
+    int full_scan_period;
+    /* The detector looks at the frame shrunk by this much in each direction */
+    int detect_scale;
+    /* Mean grey level change below which a frame keeps the last result */
+    double motion_threshold;
+    /* Seconds without a face or motion before detection backs off */
+    double idle_after;
+    /* Frames between detections once backed off */
+    int idle_period;
+    /* Faces replaced per frame, largest first */
+    int max_faces;
+    greplace::Smoothing smoothing;
+    /* Output in colour; the replacement is still drawn on the luma only */
+    bool colour;
+    /* Colour frames are left in YCrCb, for a sink that writes them so */
+    bool ycrcb_output;
+    /* Threads for tiled composition, or 0 to compose whole frames */
+    int tile_threads;
+    /* Composes SMOOTH_FRAME frames in cache sized tiles, if set */
+    greplace::WorkerPool * tiles;
+    greplace::DetectorBackend detector;
+    /* Threads for the native detector, or 0 to detect on the calling thread */
+    int detect_threads;
+    /* Shares native detection out by scale and band of rows, if set */
+    greplace::WorkerPool * detections;
+    /* Where finished frames go besides the window, if anywhere */
+    greplace::Sink * sink;
+    /* The window, unless running headless */
+    greplace::Display * display;
+  };
+}
+
+#endif
@@ -0,0 +1,100 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "parallel.hpp"
+
+greplace::WorkerPool::WorkerPool(int threads)
+  : task(NULL), count(0), next(0), busy(0), generation(0), stopping(false) {
+  for (int i = 1; i < threads; i ++) {
+    this->threads.push_back(std::thread(&WorkerPool::work, this, i));
+  }
+}
+
+greplace::WorkerPool::~WorkerPool(void) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  start.notify_all();
+  for (size_t i = 0; i < threads.size(); i ++) {
+    threads[i].join();
+  }
+}
+
+int greplace::WorkerPool::size(void) const {
+  return static_cast<int>(threads.size()) + 1;
+}
+
+void greplace::WorkerPool::run(int count,
+                               const std::function<void(int, int)> & task) {
+  std::lock_guard<std::mutex> job(job_mutex);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->task = &task;
+    this->count = count;
+    next = 0;
+    busy = static_cast<int>(threads.size());
+    generation++;
+  }
+  start.notify_all();
+  take_tasks(0);
+  /* TASK belongs to the caller, so every thread must be done with it */
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&]() { return busy == 0; });
+  this->task = NULL;
+}
+
+void greplace::WorkerPool::take_tasks(int worker) {
+  for (;;) {
+    int i;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (next >= count) {
+        return;
+      }
+      i = next++;
+    }
+    (*task)(i, worker);
+  }
+}
+
+void greplace::WorkerPool::work(int worker) {
+  unsigned long seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      start.wait(lock, [&]() { return stopping || generation != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+    }
+    take_tasks(worker);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      busy--;
+    }
+    finished.notify_all();
+  }
+}
@@ -0,0 +1,69 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_PARALLEL_HPP
+#define _GREPLACE_PARALLEL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace greplace {
+  /*
+   * A fixed set of threads that share out the numbered tasks of one job at a
+   * time. The thread that calls run() works on the job too, so a pool of one
+   * runs everything in place. Jobs from different callers take turns.
+   */
+  class WorkerPool {
+  public:
+    explicit WorkerPool(int threads);
+    ~WorkerPool(void);
+    /* Threads working on each job, including the caller */
+    int size(void) const;
+    /*
+     * Calls TASK(i, worker) for each i in [0, COUNT) and returns once all of
+     * them have finished. WORKER is below size() and no two calls running at
+     * the same time share one, so it can pick per thread scratch space.
+     */
+    void run(int count, const std::function<void(int, int)> & task);
+  private:
+    void work(int worker);
+    void take_tasks(int worker);
+    std::vector<std::thread> threads;
+    std::mutex job_mutex;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable finished;
+    const std::function<void(int, int)> * task;
+    int count;
+    int next;
+    int busy;
+    unsigned long generation;
+    bool stopping;
+  };
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <atomic>
+#include <algorithm>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/contrib/contrib.hpp>
@@ -8,23 +10,113 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/objdetect/objdetect.hpp>
 
+#include "allocation.hpp"
 #include "person.hpp"
 
-greplace::Person::Person(void) { };
+/* Faces a gallery keeps once it starts learning the current user */
+static const size_t GALLERY_SIZE = 15;
 
-greplace::Person::Person(std::string load_directory, int x_res, int y_res) {
+/* A new gallery identity; zero is never handed out */
+static unsigned long new_gallery(void) {
+  static std::atomic<unsigned long> next(0);
+  return ++next;
+}
+
+greplace::Person::Person(void) : gallery_id(new_gallery()) { };
+
+greplace::Person::Person(std::string load_directory, int x_res, int y_res)
+  : gallery_id(new_gallery()) {
   load_training_faces(load_directory, x_res, y_res);
   label_training_faces();
 }
 
 cv::Mat greplace::Person::prediction(cv::Mat image, cv::Rect face, cv::Ptr<cv::FaceRecognizer> model) {
-  cv::Mat greyscale;
-  cvtColor(image, greyscale, CV_BGR2GRAY);
-  cv::Mat faceMat = greyscale(face);
-  cv::Mat replacement = faces[0].clone();
-  resize(faceMat, replacement, replacement.size());
-  int result = model->predict(replacement);
-  return faces[result];
+  greplace::FrameContext frame(image);
+  return prediction(frame, face, model);
+}
+
+cv::Mat greplace::Person::prediction(greplace::FrameContext & frame,
+                                     cv::Rect face,
+                                     cv::Ptr<cv::FaceRecognizer> model) {
+  return faces[predict(frame, face, model)];
+}
+
+int greplace::Person::predict(greplace::FrameContext & frame, cv::Rect face,
+                              cv::Ptr<cv::FaceRecognizer> model) {
+  return model->predict(frame.face(face, faces[0].size()));
+}
+
+greplace::PredictionBuffers::PredictionBuffers(void) {
+  greplace::count_allocations(pixels);
+  greplace::count_allocations(samples);
+  greplace::count_allocations(projected);
+  greplace::count_allocations(distances);
+}
+
+void greplace::Person::reserve(greplace::PredictionBuffers & buffers,
+                               int count) const {
+  if (subspace.empty()) {
+    return;
+  }
+  /* Retraining can grow the gallery, and the subspace with it */
+  int gallery = static_cast<int>(std::max(GALLERY_SIZE, faces.size()));
+  greplace::scratch(buffers.pixels, cv::Size(subspace.rows, count), CV_8UC1);
+  greplace::scratch(buffers.samples, cv::Size(subspace.rows, count),
+                    subspace.type());
+  greplace::scratch(buffers.projected, cv::Size(gallery, count),
+                    subspace.type());
+  greplace::scratch(buffers.distances, cv::Size(gallery, count), CV_64FC1);
+}
+
+void greplace::Person::predict(greplace::FrameContext & frame,
+                               const std::vector<cv::Rect> & regions,
+                               cv::Ptr<cv::FaceRecognizer> model,
+                               greplace::PredictionBuffers & buffers,
+                               std::vector<int> & indices) {
+  indices.resize(regions.size());
+  if (subspace.empty() || projections.empty() || regions.empty()) {
+    for (size_t i = 0; i < regions.size(); i ++) {
+      indices[i] = predict(frame, regions[i], model);
+    }
+    return;
+  }
+  cv::Size size = faces[0].size();
+  int count = static_cast<int>(regions.size());
+  /* One face to a row, as the model flattens them */
+  cv::Mat pixels = greplace::scratch(buffers.pixels,
+                                     cv::Size(size.area(), count), CV_8UC1);
+  for (int i = 0; i < count; i ++) {
+    cv::Mat sample(size.height, size.width, CV_8UC1, pixels.ptr(i));
+    resize(frame.grey(regions[i]), sample, size);
+  }
+  cv::Mat samples = greplace::scratch(buffers.samples, pixels.size(),
+                                      subspace.type());
+  pixels.convertTo(samples, subspace.type());
+  for (int i = 0; i < count; i ++) {
+    cv::Mat row = samples.row(i);
+    cv::subtract(row, subspace_mean, row);
+  }
+  cv::Mat projected = greplace::scratch(buffers.projected,
+                                        cv::Size(subspace.cols, count),
+                                        subspace.type());
+  cv::gemm(samples, subspace, 1, cv::Mat(), 0, projected);
+  /* |q - p|^2 less |q|^2, which is the same for every p */
+  cv::Mat distances = greplace::scratch(buffers.distances,
+                                        cv::Size(projections.rows, count),
+                                        CV_64FC1);
+  cv::gemm(projected, projections, -2, cv::Mat(), 0, distances,
+           cv::GEMM_2_T);
+  for (int i = 0; i < count; i ++) {
+    const double * row = distances.ptr<double>(i);
+    int nearest = 0;
+    for (int j = 1; j < distances.cols; j ++) {
+      if (row[j] + projection_norms[j] <
+          row[nearest] + projection_norms[nearest]) {
+        nearest = j;
+      }
+    }
+    indices[i] = projection_labels[nearest];
+  }
 }
 
 void greplace::Person::load_training_faces(std::string load_directory, int x_res, int y_res) {
@@ -47,11 +139,32 @@ void greplace::Person::label_training_faces(void) {
 
 void greplace::Person::train_model(cv::Ptr<cv::FaceRecognizer> model) {
   model->train(faces, labels);
+  /* Eigenfaces and Fisherfaces keep the subspace predict compares in */
+  try {
+    subspace = model->getMat("eigenvectors");
+    subspace_mean = model->getMat("mean");
+    std::vector<cv::Mat> projected = model->getMatVector("projections");
+    cv::Mat projected_labels = model->getMat("labels");
+    /* Not create, as copies of this Person may share the old one */
+    projections = cv::Mat(static_cast<int>(projected.size()), subspace.cols,
+                          subspace.type());
+    projection_norms.resize(projected.size());
+    projection_labels.resize(projected.size());
+    for (size_t i = 0; i < projected.size(); i ++) {
+      cv::Mat row = projections.row(static_cast<int>(i));
+      projected[i].copyTo(row);
+      projection_norms[i] = row.dot(row);
+      projection_labels[i] = projected_labels.at<int>(static_cast<int>(i));
+    }
+  } catch (cv::Exception & e) {
+    subspace.release();
+  }
 }
 
 void greplace::Person::update(cv::Mat face) {
+  gallery_id = new_gallery();
   faces.push_back(face);
- 	if (faces.size() > 15) {
+ 	if (faces.size() > GALLERY_SIZE) {
 		faces.erase(faces.begin() + 1);
 	}
 	if (labels.size() == 0) {
@@ -59,16 +172,25 @@ void greplace::Person::update(cv::Mat face) {
 	} else {
 		labels.push_back(labels[labels.size() - 1] + 1);
 	}
-	if (labels.size() > 15) {
+	if (labels.size() > GALLERY_SIZE) {
 		labels.pop_back();
 	}
 }
 
 void greplace::Person::clear(void) {
+  gallery_id = new_gallery();
   faces.clear();
   labels.clear();
 }
 
-cv::Mat greplace::Person::face(void) {
+cv::Mat greplace::Person::face(void) const {
   return faces[0];
 }
+
+cv::Mat greplace::Person::face(int index) const {
+  return faces[index];
+}
+
+unsigned long greplace::Person::gallery(void) const {
+  return gallery_id;
+}
@@ -10,7 +10,18 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/objdetect/objdetect.hpp>
 
+#include "frame_context.hpp"
+
 namespace greplace {
+  /* Scratch images for predicting several faces at once */
+  struct PredictionBuffers {
+    PredictionBuffers(void);
+    cv::Mat pixels;
+    cv::Mat samples;
+    cv::Mat projected;
+    cv::Mat distances;
+  };
+
   class Person {
   public:
     Person(void);
@@ -19,12 +30,43 @@ namespace greplace {
     void clear(void);
     void update(cv::Mat face);
     cv::Mat prediction(cv::Mat image, cv::Rect face, cv::Ptr<cv::FaceRecognizer> model);
-    cv::Mat face(void);
+    cv::Mat prediction(greplace::FrameContext & frame, cv::Rect face,
+                       cv::Ptr<cv::FaceRecognizer> model);
+    /* The index of the gallery face that prediction would return */
+    int predict(greplace::FrameContext & frame, cv::Rect face,
+                cv::Ptr<cv::FaceRecognizer> model);
+    /*
+     * predict for each of REGIONS at once: all of them are projected into
+     * the model's subspace by one matrix product, and compared with the whole
+     * projected gallery by another. Models that do not show their subspace
+     * are asked about one face at a time.
+     */
+    void predict(greplace::FrameContext & frame,
+                 const std::vector<cv::Rect> & regions,
+                 cv::Ptr<cv::FaceRecognizer> model,
+                 greplace::PredictionBuffers & buffers,
+                 std::vector<int> & indices);
+    /* Sizes BUFFERS for predicting COUNT faces at once, after training */
+    void reserve(greplace::PredictionBuffers & buffers, int count) const;
+    cv::Mat face(void) const;
+    cv::Mat face(int index) const;
+    /*
+     * Identifies the gallery as it stands. Any change to the faces gives a
+     * new value, which no other gallery shares; copies share the old one.
+     */
+    unsigned long gallery(void) const;
   private:
     void load_training_faces(std::string loading_directory, int x_res, int y_res);
     void label_training_faces(void);
     cv::vector<cv::Mat> faces;
     std::vector<int> labels;
+    unsigned long gallery_id;
+    /* What train_model left the model holding, for batched predictions */
+    cv::Mat subspace;
+    cv::Mat subspace_mean;
+    cv::Mat projections;
+    std::vector<double> projection_norms;
+    std::vector<int> projection_labels;
   };
 
 }
@@ -0,0 +1,152 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/contrib/contrib.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include <signal.h>
+#include <stdlib.h>
+
+#include "cpu.hpp"
+#include "sink.hpp"
+#include "display.hpp"
+#include "spsc_queue.hpp"
+#include "pipeline.hpp"
+#include "tracker.hpp"
+
+namespace {
+  struct PipelineFrame {
+    greplace::FrameContext context;
+    std::vector<cv::Rect> faces;
+    cv::Mat final_image;
+  };
+}
+
+bool greplace::pipelined_main_loop(greplace::Capture & capture,
+                                   greplace::Detector & detector,
+                                   cv::Ptr<cv::FaceRecognizer> model,
+                                   const greplace::Person & previous,
+                                   const greplace::Options & options) {
+  greplace::SpscQueue<PipelineFrame> captured(options.queue_depth);
+  greplace::SpscQueue<PipelineFrame> detected(options.queue_depth);
+  greplace::SpscQueue<PipelineFrame> composed(options.queue_depth);
+  std::atomic<bool> running(true);
+  greplace::FaceTracker tracker(options.detect_period,
+                                options.track_confidence,
+                                options.full_scan_period,
+                                options.detect_scale,
+                                options.motion_threshold,
+                                options.idle_after, options.idle_period,
+                                options.max_faces);
+  signal(SIGINT, greplace::exit_handler);
+
+  std::thread capture_thread([&]() {
+    while (running.load() && !greplace::exit_requested) {
+      PipelineFrame frame;
+      /* Kept, as the frame is still queued when the next one is read */
+      if (!capture.read(frame.context, true)) {
+        break;
+      }
+      frame.context.keep_chroma(options.colour);
+      if (!captured.push(frame)) {
+        break;
+      }
+    }
+    captured.close();
+  });
+
+  std::thread detection_thread([&]() {
+    PipelineFrame frame;
+    while (captured.pop(frame)) {
+      tracker.locate(frame.context, detector, options.threshold,
+                     frame.faces);
+      if (!detected.push(frame)) {
+        break;
+      }
+    }
+    detected.close();
+  });
+
+  std::thread composition_thread([&]() {
+    greplace::FrameState state(previous);
+    greplace::ComposeBuffers buffers;
+    std::vector<greplace::Replacement> replacements;
+    PipelineFrame frame;
+    while (detected.pop(frame)) {
+      recognise(state, frame.context, frame.faces, model,
+                options.interperson_period, replacements);
+      frame.final_image = compose(frame.context, frame.faces, replacements,
+                                  options, buffers);
+      if (!composed.push(frame)) {
+        break;
+      }
+    }
+    composed.close();
+  });
+
+  PipelineFrame frame;
+  int frmCnt = 0;
+  bool interrupted = false;
+  double start = static_cast<double>(cv::getTickCount());
+  while (composed.pop(frame)) {
+    if (options.sink != NULL) {
+      options.sink->write(frame.final_image);
+    }
+    frmCnt++;
+    if (options.display == NULL) {
+      continue;
+    }
+    options.display->write(frame.final_image);
+    double totalT = (static_cast<double>(cv::getTickCount()) - start) /
+                    cv::getTickFrequency();
+    std::cout << "fps: " << frmCnt / totalT << std::endl;
+    if (options.display->key_pressed()) {
+      interrupted = true;
+      break;
+    }
+  }
+  running.store(false);
+  captured.close();
+  detected.close();
+  composed.close();
+  capture_thread.join();
+  detection_thread.join();
+  composition_thread.join();
+  if (!interrupted) {
+    /* End of the input */
+    greplace::report_throughput(frmCnt, start);
+    if (options.detect_period > 1 || options.motion_threshold > 0) {
+      tracker.report();
+    }
+    return true;
+  }
+  return false;
+}
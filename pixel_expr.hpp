@@ -0,0 +1,174 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_PIXEL_EXPR_HPP
+#define _GREPLACE_PIXEL_EXPR_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <stddef.h>
+
+#include "kernels.hpp"
+
+/*
+ * Per pixel stages that compose at compile time into one loop over an
+ * image, so chains of operations keep each pixel in registers instead of
+ * writing a full image between steps. Every stage has set_row(y), called
+ * once per row, and operator()(x), giving the 8-bit value at column x.
+ * evaluate() runs an expression into an output image, optionally passing
+ * each value written to a tap such as a histogram, one value at a time or,
+ * after a vectorised stage, a row at a time.
+ */
+namespace greplace {
+namespace expr {
+  /* An 8-bit single channel image, read COLUMN_OFFSET columns to the right */
+  class Plane {
+  public:
+    explicit Plane(const cv::Mat & image, int column_offset = 0)
+      : image(image), offset(column_offset), row(NULL) { }
+    void set_row(int y) {
+      row = image.ptr<uchar>(y) + offset;
+    }
+    unsigned int operator()(int x) const {
+      return row[x];
+    }
+    const uchar * row_pointer(void) const {
+      return row;
+    }
+  private:
+    cv::Mat image;
+    int offset;
+    const uchar * row;
+  };
+
+  /* Alpha of 255 everywhere */
+  class Opaque {
+  public:
+    void set_row(int y) { }
+    unsigned int operator()(int x) const {
+      return 255;
+    }
+    const uchar * row_pointer(void) const {
+      return NULL;
+    }
+  };
+
+  /* x / 255 rounded to nearest, exact for x up to 255 * 255 */
+  inline unsigned int div255(unsigned int x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+  }
+
+  /*
+   * S laid over D: with a = A / 255 and b = B / 255, a * S + (1 - a) * b * D,
+   * each product rounded to 8 bits and the sum clamped, as alpha_compose did.
+   */
+  template <class S, class A, class D, class B>
+  class Lerp {
+  public:
+    Lerp(S s, A a, D d, B b) : s(s), a(a), d(d), b(b) { }
+    void set_row(int y) {
+      s.set_row(y);
+      a.set_row(y);
+      d.set_row(y);
+      b.set_row(y);
+    }
+    unsigned int operator()(int x) const {
+      unsigned int alpha = a(x);
+      unsigned int dst_weight = div255(b(x) * (255 - alpha));
+      unsigned int v = div255(alpha * s(x)) + div255(dst_weight * d(x));
+      return v > 255 ? 255 : v;
+    }
+    S s;
+    A a;
+    D d;
+    B b;
+  };
+
+  template <class S, class A, class D, class B>
+  Lerp<S, A, D, B> lerp(S s, A a, D d, B b) {
+    return Lerp<S, A, D, B>(s, a, d, b);
+  }
+
+  /* Discards the values written */
+  class NoTap {
+  public:
+    void operator()(uchar v) const { }
+    void row(const uchar * values, int count) const { }
+  };
+
+  /* Counts the values written into 256 bins */
+  class HistogramTap {
+  public:
+    explicit HistogramTap(unsigned int * bins) : bins(bins) { }
+    void operator()(uchar v) const {
+      bins[v]++;
+    }
+    void row(const uchar * values, int count) const {
+      for (int x = 0; x < count; x ++) {
+        bins[values[x]]++;
+      }
+    }
+  private:
+    unsigned int * bins;
+  };
+
+  /* Writes EXPR into every pixel of OUT in one fused loop */
+  template <class E, class Tap>
+  void evaluate(E expr, cv::Mat & out, Tap tap) {
+    for (int y = 0; y < out.rows; y ++) {
+      expr.set_row(y);
+      uchar * o = out.ptr<uchar>(y);
+      for (int x = 0; x < out.cols; x ++) {
+        uchar v = static_cast<uchar>(expr(x));
+        o[x] = v;
+        tap(v);
+      }
+    }
+  }
+
+  /*
+   * A lerp of whole planes is blend_row, in the widest vectors the CPU has;
+   * the tap then reads each row back while it is still in L1
+   */
+  template <class B, class Tap>
+  void evaluate(Lerp<Plane, Plane, Plane, B> expr, cv::Mat & out, Tap tap) {
+    const greplace::KernelTable & k = greplace::kernels();
+    for (int y = 0; y < out.rows; y ++) {
+      expr.set_row(y);
+      uchar * o = out.ptr<uchar>(y);
+      k.blend_row(expr.s.row_pointer(), expr.a.row_pointer(),
+                  expr.d.row_pointer(), expr.b.row_pointer(), o, out.cols);
+      tap.row(o, out.cols);
+    }
+  }
+
+  template <class E>
+  void evaluate(E expr, cv::Mat & out) {
+    evaluate(expr, out, NoTap());
+  }
+}
+}
+
+#endif
@@ -0,0 +1,80 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+#include <algorithm>
+
+#include <math.h>
+
+#include "cpu.hpp"
+#include "planner.hpp"
+
+greplace::DetectionPlanner::DetectionPlanner(int full_scan_period, int scale)
+  : full_scan_period(full_scan_period), scale(scale), since_full_scan(0) { }
+
+greplace::DetectionPlan greplace::full_frame_plan(cv::Size frame,
+                                                  int threshold, int scale) {
+  /* The cascade finds square faces, so anything narrower is too small */
+  int side = static_cast<int>(ceil(sqrt(static_cast<double>(threshold))));
+  greplace::DetectionPlan plan;
+  plan.region = cv::Rect(0, 0, frame.width, frame.height);
+  plan.min_size = cv::Size(side, side);
+  plan.scale = scale;
+  return plan;
+}
+
+cv::Rect greplace::DetectionPlanner::detect(greplace::FrameContext & frame,
+                                            greplace::Detector & detector,
+                                            int threshold, cv::Rect previous) {
+  greplace::DetectionPlan plan = full_frame_plan(frame.size(),
+                                                 threshold, scale);
+  since_full_scan++;
+  if (previous.area() != 0 && since_full_scan < full_scan_period) {
+    /*
+     * rects_overlap needs half the union covered, so a face that still
+     * counts as this one is within a factor of sqrt(2) of its size and lies
+     * within half its size of where it was.
+     */
+    greplace::DetectionPlan local = plan;
+    local.region = cv::Rect(previous.x - previous.width / 2,
+                            previous.y - previous.height / 2,
+                            previous.width * 2, previous.height * 2);
+    local.region &= plan.region;
+    int smallest = static_cast<int>(previous.width / sqrt(2.0));
+    int largest = static_cast<int>(ceil(previous.width * sqrt(2.0)));
+    local.min_size.width = std::max(local.min_size.width, smallest);
+    local.min_size.height = std::max(local.min_size.height, smallest);
+    local.max_size = cv::Size(largest, largest);
+    cv::Rect face = greplace::find_planned_face(frame, detector,
+                                                threshold, local);
+    if (face.area() != 0) {
+      return face;
+    }
+    /* Moved further than a frame allows, or gone; look everywhere */
+  }
+  since_full_scan = 0;
+  return greplace::find_planned_face(frame, detector, threshold, plan);
+}
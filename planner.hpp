@@ -0,0 +1,68 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_PLANNER_HPP
+#define _GREPLACE_PLANNER_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include "detector.hpp"
+#include "frame_context.hpp"
+
+namespace greplace {
+  /* The part of the frame, and the range of face sizes, to run the cascade on */
+  struct DetectionPlan {
+    cv::Rect region;
+    cv::Size min_size;
+    cv::Size max_size;
+    /* Searched in an image this many times smaller than the frame */
+    int scale;
+  };
+
+  /*
+   * Plans each detection so the cascade skips regions and scales whose
+   * results would be thrown away. Faces smaller than the threshold are never
+   * searched for. Once a face is known, only a window around it is searched,
+   * at sizes close enough to overlap it as recognise requires. Every
+   * full_scan_period frames, or when the window turns up nothing, the whole
+   * frame is scanned so new faces are still found.
+   */
+  class DetectionPlanner {
+  public:
+    DetectionPlanner(int full_scan_period, int scale);
+    /* PREVIOUS is where the face was in the last frame, if anywhere */
+    cv::Rect detect(greplace::FrameContext & frame,
+                    greplace::Detector & detector, int threshold,
+                    cv::Rect previous);
+  private:
+    int full_scan_period;
+    int scale;
+    int since_full_scan;
+  };
+
+  /* The whole frame, at every size that can pass THRESHOLD */
+  DetectionPlan full_frame_plan(cv::Size frame, int threshold, int scale);
+}
+
+#endif
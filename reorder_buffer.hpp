@@ -0,0 +1,97 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_REORDER_BUFFER_HPP
+#define _GREPLACE_REORDER_BUFFER_HPP
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+#include <stddef.h>
+
+namespace greplace {
+  /*
+   * Collects items tagged with a sequence number from any number of threads
+   * and hands them back in sequence order. Producers block while their item
+   * is more than WINDOW places ahead of the next item to be taken.
+   */
+  template <typename T>
+  class ReorderBuffer {
+  public:
+    explicit ReorderBuffer(size_t window)
+      : window(window), next(0), closed(false) { }
+
+    /* Returns false if the buffer was closed while waiting */
+    bool put(size_t sequence, T & item) {
+      std::unique_lock<std::mutex> lock(mutex);
+      space.wait(lock, [&]() {
+        return closed || sequence < next + window;
+      });
+      if (closed) {
+        return false;
+      }
+      pending[sequence] = std::move(item);
+      if (sequence == next) {
+        ready.notify_all();
+      }
+      return true;
+    }
+
+    /* Returns false once the buffer is closed and the next item is missing */
+    bool take(T & item) {
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [&]() {
+        return closed || pending.count(next) != 0;
+      });
+      typename std::map<size_t, T>::iterator it = pending.find(next);
+      if (it == pending.end()) {
+        return false;
+      }
+      item = std::move(it->second);
+      pending.erase(it);
+      next++;
+      space.notify_all();
+      return true;
+    }
+
+    void close(void) {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+      ready.notify_all();
+      space.notify_all();
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable space;
+    std::map<size_t, T> pending;
+    size_t window;
+    size_t next;
+    bool closed;
+  };
+}
+
+#endif
@@ -0,0 +1,79 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+
+#include "alpha_mask.hpp"
+#include "replacement_cache.hpp"
+
+const int greplace::REPLACEMENT_QUANTUM = 4;
+
+static int quantize(int n) {
+  int q = greplace::REPLACEMENT_QUANTUM;
+  return std::max(q, (n + q / 2) / q * q);
+}
+
+greplace::ReplacementCache::ReplacementCache(size_t capacity)
+  : capacity(capacity), gallery(0) { }
+
+const greplace::ReplacementTexture & greplace::ReplacementCache::texture(
+    const greplace::Replacement & replacement, cv::Size face_size, double r0,
+    double rf) {
+  if (replacement.gallery != gallery) {
+    /* The gallery changed, so its indices mean other faces now */
+    entries.clear();
+    gallery = replacement.gallery;
+  }
+  cv::Size key(quantize(face_size.width), quantize(face_size.height));
+  std::list<Entry>::iterator it = entries.begin();
+  while (it != entries.end() && (it->index != replacement.index ||
+                                 it->size != key || it->r0 != r0 ||
+                                 it->rf != rf)) {
+    ++it;
+  }
+  if (it == entries.end()) {
+    if (entries.size() >= capacity) {
+      entries.pop_back();
+    }
+    Entry entry;
+    entry.index = replacement.index;
+    entry.size = key;
+    entry.r0 = r0;
+    entry.rf = rf;
+    cv::Mat scaled;
+    resize(replacement.face, scaled, key);
+    cv::Rect inner(key.width / 10, key.height / 10, key.width * 4 / 5,
+                   key.height * 4 / 5);
+    entry.prepared.texture = scaled(inner).clone();
+    entry.prepared.mask = greplace::radial_alpha_mask(inner.size(), r0, rf,
+                                                      false);
+    entries.push_front(entry);
+  } else if (it != entries.begin()) {
+    entries.splice(entries.begin(), entries, it);
+  }
+  return entries.front().prepared;
+}
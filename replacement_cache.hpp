@@ -0,0 +1,83 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_REPLACEMENT_CACHE_HPP
+#define _GREPLACE_REPLACEMENT_CACHE_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <list>
+
+#include <stddef.h>
+
+namespace greplace {
+  /* The gallery face recognition picked to draw over a detected face */
+  struct Replacement {
+    Replacement(void) : gallery(0), index(-1) { }
+    bool empty(void) const { return face.empty(); }
+    cv::Mat face;
+    /* Person::gallery() of the gallery FACE came from, and its place there */
+    unsigned long gallery;
+    int index;
+  };
+
+  /* A replacement ready to blend: scaled, cropped to its inner part, masked */
+  struct ReplacementTexture {
+    cv::Mat texture;
+    cv::Mat mask;
+  };
+
+  /*
+   * Prepared replacements, keyed by gallery face and by face size rounded
+   * to REPLACEMENT_QUANTUM, so a steady face costs a single blend. A face
+   * from a different gallery empties the cache, and the least recently used
+   * texture is dropped once it holds its capacity.
+   */
+  class ReplacementCache {
+  public:
+    explicit ReplacementCache(size_t capacity);
+    /*
+     * REPLACEMENT prepared for a face of about FACE_SIZE, with an alpha
+     * mask opaque inside r0 and clear outside rf. Valid until the next call.
+     */
+    const greplace::ReplacementTexture & texture(
+        const greplace::Replacement & replacement, cv::Size face_size,
+        double r0, double rf);
+  private:
+    struct Entry {
+      int index;
+      cv::Size size;
+      double r0;
+      double rf;
+      greplace::ReplacementTexture prepared;
+    };
+    std::list<Entry> entries;
+    size_t capacity;
+    unsigned long gallery;
+  };
+
+  extern const int REPLACEMENT_QUANTUM;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+
+#include "allocation.hpp"
+#include "scheduler.hpp"
+
+greplace::ActivityScheduler::ActivityScheduler(double motion_threshold,
+                                               double idle_after,
+                                               int idle_period)
+  : motion_threshold(motion_threshold),
+    idle_ticks(idle_after * cv::getTickFrequency()),
+    idle_period(std::max(idle_period, 1)),
+    last_active(static_cast<double>(cv::getTickCount())), since_detection(0),
+    skips(0), idle_frames(0) {
+  greplace::count_allocations(previous);
+  greplace::count_allocations(current);
+  greplace::count_allocations(reference);
+}
+
+double greplace::grey_difference(const cv::Mat & a, const cv::Mat & b) {
+  return cv::norm(a, b, cv::NORM_L1) / std::max(a.size().area(), 1);
+}
+
+bool greplace::ActivityScheduler::needed(greplace::FrameContext & frame) {
+  if (motion_threshold <= 0) {
+    return true;
+  }
+  const cv::Mat & small = frame.detection_grey(ACTIVITY_SCALE);
+  std::swap(previous, current);
+  cv::Mat sample = greplace::scratch(current, small.size(), CV_8UC1);
+  small.copyTo(sample);
+  double now = static_cast<double>(cv::getTickCount());
+  since_detection++;
+  bool changed = reference.empty() || reference.size() != small.size() ||
+                 grey_difference(current, reference) >= motion_threshold;
+  bool moving = previous.empty() || previous.size() != small.size() ||
+                grey_difference(current, previous) >= motion_threshold;
+  if (moving) {
+    last_active = now;
+  }
+  bool idle = now - last_active >= idle_ticks;
+  if (idle) {
+    idle_frames++;
+  }
+  if (!changed || (idle && !moving && since_detection < idle_period)) {
+    skips++;
+    return false;
+  }
+  cv::Mat kept = greplace::scratch(reference, small.size(), CV_8UC1);
+  current.copyTo(kept);
+  since_detection = 0;
+  return true;
+}
+
+void greplace::ActivityScheduler::located(bool found) {
+  if (found) {
+    last_active = static_cast<double>(cv::getTickCount());
+  }
+}
@@ -0,0 +1,74 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_SCHEDULER_HPP
+#define _GREPLACE_SCHEDULER_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include "frame_context.hpp"
+
+namespace greplace {
+  /*
+   * Decides which frames need the detector, from how much a grey copy of
+   * each frame shrunk ACTIVITY_SCALE times has changed. A frame that differs
+   * from the last one detected on by less than motion_threshold, as a mean
+   * absolute grey level, keeps the last result. Once there has been no face
+   * and no motion from one frame to the next for idle_after seconds, frames
+   * that have only drifted, with lighting say, are detected on every
+   * idle_period frames; any motion returns to detecting on every changed
+   * frame at once. A threshold of 0 detects on every frame.
+   */
+  class ActivityScheduler {
+  public:
+    ActivityScheduler(double motion_threshold, double idle_after,
+                      int idle_period);
+    /* Frames must be passed in capture order */
+    bool needed(greplace::FrameContext & frame);
+    /* Tells the scheduler whether the frame it asked for had a face */
+    void located(bool found);
+    int skipped(void) const { return skips; }
+    int idle(void) const { return idle_frames; }
+  private:
+    double motion_threshold;
+    double idle_ticks;
+    int idle_period;
+    cv::Mat previous;
+    cv::Mat current;
+    /* The frame the last result was found in */
+    cv::Mat reference;
+    double last_active;
+    int since_detection;
+    int skips;
+    int idle_frames;
+  };
+
+  /* The scheduler samples frames shrunk by this much in each direction */
+  const int ACTIVITY_SCALE = 8;
+
+  /* Mean absolute difference between two grey images of the same size */
+  double grey_difference(const cv::Mat & a, const cv::Mat & b);
+}
+
+#endif
@@ -0,0 +1,214 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <string>
+#include <iostream>
+#include <sstream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sink.hpp"
+
+static bool ends_with(const std::string & s, const char * suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+greplace::VideoFileSink::VideoFileSink(std::string path, double fps)
+  : path(path), fps(fps) { }
+
+void greplace::VideoFileSink::write(const cv::Mat & frame) {
+  if (!writer.isOpened()) {
+    int fourcc = CV_FOURCC('M', 'J', 'P', 'G');
+    if (ends_with(path, ".mp4")) {
+      fourcc = CV_FOURCC('m', 'p', '4', 'v');
+    }
+    if (!writer.open(path, fourcc, fps, frame.size(), true)) {
+      std::cout << "greplace: Could not open " << path << std::endl;
+      return;
+    }
+  }
+  /* Grey frames are only accepted by the Windows backends */
+  if (frame.channels() == 1) {
+    cvtColor(frame, bgr, CV_GRAY2BGR);
+    writer << bgr;
+  } else {
+    writer << frame;
+  }
+}
+
+greplace::RawSink::RawSink(std::string path) : failed(false) {
+  /* Report a reader that goes away as an error rather than dying */
+  signal(SIGPIPE, SIG_IGN);
+  if (path == "-") {
+    /* Keep stdout for frames; anything printed from now on goes to stderr */
+    std::cout.flush();
+    fd = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+  } else {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  if (fd < 0) {
+    std::cout << "greplace: Could not open " << path << std::endl;
+    failed = true;
+  }
+}
+
+greplace::RawSink::~RawSink(void) {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void greplace::RawSink::write_bytes(const void * data, size_t length) {
+  const char * p = static_cast<const char *>(data);
+  while (!failed && length > 0) {
+    ssize_t n = ::write(fd, p, length);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cout << "greplace: Output failed: " << strerror(errno) << std::endl;
+      failed = true;
+      return;
+    }
+    p += n;
+    length -= n;
+  }
+}
+
+void greplace::RawSink::write(const cv::Mat & frame) {
+  size_t row_bytes = frame.cols * frame.elemSize();
+  if (frame.isContinuous()) {
+    write_bytes(frame.data, row_bytes * frame.rows);
+    return;
+  }
+  for (int row = 0; row < frame.rows; row ++) {
+    write_bytes(frame.ptr(row), row_bytes);
+  }
+}
+
+greplace::Y4MSink::Y4MSink(std::string path, double fps)
+  : RawSink(path), fps(fps), header_written(false) { }
+
+void greplace::Y4MSink::write(const cv::Mat & frame) {
+  if (!header_written) {
+    std::ostringstream header;
+    header << "YUV4MPEG2 W" << frame.cols << " H" << frame.rows;
+    header << " F" << cvRound(fps * 1000) << ":1000 Ip A1:1 ";
+    header << (frame.channels() == 1 ? "Cmono" : "C444");
+    header << " XCOLORRANGE=FULL\n";
+    write_bytes(header.str().data(), header.str().size());
+    header_written = true;
+  }
+  write_bytes("FRAME\n", 6);
+  if (frame.channels() == 1) {
+    RawSink::write(frame);
+    return;
+  }
+  /* Y4M planes come in Y, Cb, Cr order */
+  cv::split(frame, planes);
+  RawSink::write(planes[0]);
+  RawSink::write(planes[2]);
+  RawSink::write(planes[1]);
+}
+
+greplace::AsyncSink::AsyncSink(Sink * sink, size_t depth)
+  : sink(sink), pending(depth), recycled(depth), depth(depth), allocated(0),
+    frames(0), drops(0) {
+  encoder = std::thread(&greplace::AsyncSink::run, this);
+}
+
+greplace::AsyncSink::~AsyncSink(void) {
+  pending.close();
+  encoder.join();
+  if (drops > 0) {
+    std::cout << "greplace: Output dropped " << drops << " of ";
+    std::cout << frames + drops << " frames" << std::endl;
+  }
+  delete sink;
+}
+
+void greplace::AsyncSink::write(const cv::Mat & frame) {
+  cv::Mat buffer;
+  if (!recycled.try_pop(buffer)) {
+    if (allocated == depth) {
+      /* The encoder is holding every buffer */
+      drops++;
+      return;
+    }
+    allocated++;
+  }
+  frame.copyTo(buffer);
+  /* Never waits, as there are only depth buffers in circulation */
+  pending.push(buffer);
+  frames++;
+}
+
+size_t greplace::AsyncSink::written(void) const {
+  return frames;
+}
+
+size_t greplace::AsyncSink::dropped(void) const {
+  return drops;
+}
+
+void greplace::AsyncSink::run(void) {
+  cv::Mat buffer;
+  while (pending.pop(buffer)) {
+    sink->write(buffer);
+    recycled.push(buffer);
+  }
+}
+
+greplace::Sink * greplace::create_sink(const char * path, const char * format,
+                                       double fps) {
+  std::string p(path);
+  std::string f = (format != NULL) ? format : "";
+  if (f.empty()) {
+    if (p == "-" || ends_with(p, ".raw") || ends_with(p, ".gray")) {
+      f = "raw";
+    } else if (ends_with(p, ".y4m")) {
+      f = "y4m";
+    } else {
+      f = "video";
+    }
+  }
+  if (f == "raw") {
+    return new greplace::RawSink(p);
+  }
+  if (f == "y4m") {
+    return new greplace::Y4MSink(p, fps);
+  }
+  return new greplace::VideoFileSink(p, fps);
+}
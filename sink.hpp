@@ -0,0 +1,123 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_SINK_HPP
+#define _GREPLACE_SINK_HPP
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stddef.h>
+
+#include "spsc_queue.hpp"
+
+namespace greplace {
+  /* Somewhere for the main loop to send its finished frames */
+  class Sink {
+  public:
+    virtual ~Sink(void) { }
+    virtual void write(const cv::Mat & frame) = 0;
+    /* True if colour frames should come in YCrCb rather than BGR */
+    virtual bool takes_ycrcb(void) const { return false; }
+  };
+
+  /* Encodes to a video file through cv::VideoWriter */
+  class VideoFileSink : public Sink {
+  public:
+    VideoFileSink(std::string path, double fps);
+    void write(const cv::Mat & frame);
+  private:
+    std::string path;
+    double fps;
+    cv::VideoWriter writer;
+    cv::Mat bgr;
+  };
+
+  /* Writes bare 8-bit frames, row after row, to a file, pipe or stdout */
+  class RawSink : public Sink {
+  public:
+    RawSink(std::string path);
+    ~RawSink(void);
+    void write(const cv::Mat & frame);
+  protected:
+    void write_bytes(const void * data, size_t length);
+    int fd;
+    bool failed;
+  };
+
+  /*
+   * Writes a YUV4MPEG2 stream that ffmpeg and friends can read directly.
+   * Grey frames go out as mono, colour frames, which must be YCrCb, as
+   * planar 4:4:4. Both are full range, as OpenCV converts.
+   */
+  class Y4MSink : public RawSink {
+  public:
+    Y4MSink(std::string path, double fps);
+    void write(const cv::Mat & frame);
+    bool takes_ycrcb(void) const { return true; }
+  private:
+    double fps;
+    bool header_written;
+    std::vector<cv::Mat> planes;
+  };
+
+  /*
+   * Runs another sink on its own thread. write() copies the frame into a
+   * recycled buffer and returns straight away; if every buffer is still
+   * queued for the encoder the frame is dropped and counted instead. The
+   * wrapped sink is deleted with this one.
+   */
+  class AsyncSink : public Sink {
+  public:
+    AsyncSink(Sink * sink, size_t depth);
+    ~AsyncSink(void);
+    void write(const cv::Mat & frame);
+    bool takes_ycrcb(void) const { return sink->takes_ycrcb(); }
+    size_t written(void) const;
+    size_t dropped(void) const;
+  private:
+    void run(void);
+    Sink * sink;
+    greplace::SpscQueue<cv::Mat> pending;
+    greplace::SpscQueue<cv::Mat> recycled;
+    size_t depth;
+    size_t allocated;
+    size_t frames;
+    size_t drops;
+    std::thread encoder;
+  };
+
+  /*
+   * Makes the sink for PATH. FORMAT is "video", "raw" or "y4m"; if it is
+   * NULL the format is guessed from the path, with "-" meaning raw frames
+   * on stdout.
+   */
+  Sink * create_sink(const char * path, const char * format, double fps);
+}
+
+#endif
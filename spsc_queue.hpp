@@ -0,0 +1,101 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_SPSC_QUEUE_HPP
+#define _GREPLACE_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <stddef.h>
+
+namespace greplace {
+  /*
+   * Bounded single producer, single consumer ring buffer. One slot is kept
+   * empty to tell a full queue from an empty one, so a queue of depth n holds
+   * n elements. The blocking calls spin with a yield; close() wakes both ends.
+   */
+  template <typename T>
+  class SpscQueue {
+  public:
+    explicit SpscQueue(size_t depth)
+      : slots(depth + 1), head(0), tail(0), closed(false) { }
+
+    bool try_push(T & item) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      size_t next = (t + 1) % slots.size();
+      if (next == head.load(std::memory_order_acquire)) {
+        return false;
+      }
+      slots[t] = std::move(item);
+      tail.store(next, std::memory_order_release);
+      return true;
+    }
+
+    bool try_pop(T & item) {
+      size_t h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire)) {
+        return false;
+      }
+      item = std::move(slots[h]);
+      head.store((h + 1) % slots.size(), std::memory_order_release);
+      return true;
+    }
+
+    /* Returns false if the queue was closed before the item could be added */
+    bool push(T & item) {
+      while (!try_push(item)) {
+        if (closed.load(std::memory_order_acquire)) {
+          return false;
+        }
+        std::this_thread::yield();
+      }
+      return true;
+    }
+
+    /* Returns false once the queue is closed and drained */
+    bool pop(T & item) {
+      while (!try_pop(item)) {
+        if (closed.load(std::memory_order_acquire)) {
+          return try_pop(item);
+        }
+        std::this_thread::yield();
+      }
+      return true;
+    }
+
+    void close(void) {
+      closed.store(true, std::memory_order_release);
+    }
+
+  private:
+    std::vector<T> slots;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<bool> closed;
+  };
+}
+
+#endif
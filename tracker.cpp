@@ -0,0 +1,137 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+#include <iostream>
+
+#include "allocation.hpp"
+#include "cpu.hpp"
+#include "tracker.hpp"
+
+greplace::FaceTracker::FaceTracker(int detect_period, double min_confidence,
+                                   int full_scan_period, int detect_scale,
+                                   double motion_threshold, double idle_after,
+                                   int idle_period, int max_faces)
+  : detect_period(detect_period), min_confidence(min_confidence),
+    planner(full_scan_period, detect_scale),
+    scheduler(motion_threshold, idle_after, idle_period), max_faces(max_faces),
+    detect_scale(detect_scale), since_detection(0), detections(0), tracks(0),
+    detect_ticks(0.0), track_ticks(0.0) {
+  greplace::count_allocations(face_template);
+  greplace::count_allocations(response);
+}
+
+void greplace::FaceTracker::locate(greplace::FrameContext & frame,
+                                   greplace::Detector & detector,
+                                   int threshold,
+                                   std::vector<cv::Rect> & faces) {
+  if (!scheduler.needed(frame)) {
+    faces = found;
+    return;
+  }
+  if (max_faces > 1) {
+    double t = static_cast<double>(cv::getTickCount());
+    greplace::find_possible_faces(frame, detector, threshold, max_faces,
+                                  detect_scale, found);
+    detections++;
+    detect_ticks += static_cast<double>(cv::getTickCount()) - t;
+    scheduler.located(!found.empty());
+  } else {
+    face = follow(frame, detector, threshold);
+    found.clear();
+    if (face.area() != 0) {
+      found.push_back(face);
+    }
+  }
+  faces = found;
+}
+
+cv::Rect greplace::FaceTracker::follow(greplace::FrameContext & frame,
+                                       greplace::Detector & detector,
+                                       int threshold) {
+  double t = static_cast<double>(cv::getTickCount());
+  if (detect_period > 1 && face.area() != 0 &&
+      since_detection < detect_period) {
+    double confidence;
+    cv::Rect tracked = track(frame, confidence);
+    if (confidence >= min_confidence) {
+      face = tracked;
+      since_detection++;
+      tracks++;
+      track_ticks += static_cast<double>(cv::getTickCount()) - t;
+      scheduler.located(true);
+      return face;
+    }
+    /* Lost it; fall through to the cascade */
+  }
+  face = planner.detect(frame, detector, threshold, face);
+  since_detection = 1;
+  if (detect_period > 1 && face.area() != 0) {
+    /* Taken before compose draws over the face */
+    cv::Mat patch = greplace::scratch(face_template, face.size(), CV_8UC1);
+    frame.grey(face).copyTo(patch);
+  }
+  detections++;
+  detect_ticks += static_cast<double>(cv::getTickCount()) - t;
+  scheduler.located(face.area() != 0);
+  return face;
+}
+
+cv::Rect greplace::FaceTracker::track(greplace::FrameContext & frame,
+                                      double & confidence) {
+  /* The face may move up to half its size in any direction per frame */
+  cv::Rect window(face.x - face.width / 2, face.y - face.height / 2,
+                  face.width * 2, face.height * 2);
+  window &= cv::Rect(cv::Point(0, 0), frame.size());
+  cv::Mat patch = face_template(cv::Rect(0, 0, face.width, face.height));
+  cv::Mat scores = greplace::scratch(response,
+                                     cv::Size(window.width - face.width + 1,
+                                              window.height - face.height + 1),
+                                     CV_32FC1);
+  cv::matchTemplate(frame.grey(window), patch, scores, CV_TM_CCOEFF_NORMED);
+  cv::Point best;
+  cv::minMaxLoc(scores, NULL, &confidence, NULL, &best);
+  return cv::Rect(window.x + best.x, window.y + best.y,
+                  face.width, face.height);
+}
+
+void greplace::FaceTracker::report(void) const {
+  double frequency = cv::getTickFrequency() / 1000.0;
+  std::cout << "greplace: Detector " << detections << " frames";
+  if (detections > 0) {
+    std::cout << ", " << detect_ticks / frequency / detections << " ms each";
+  }
+  std::cout << "; tracker " << tracks << " frames";
+  if (tracks > 0) {
+    std::cout << ", " << track_ticks / frequency / tracks << " ms each";
+  }
+  if (scheduler.skipped() > 0 || scheduler.idle() > 0) {
+    std::cout << "; unchanged " << scheduler.skipped() << " frames, idle ";
+    std::cout << scheduler.idle() << " frames";
+  }
+  std::cout << std::endl;
+}
@@ -0,0 +1,82 @@
+/* 
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Michael Lancaster <mjl152@uclive.ac.nz>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _GREPLACE_TRACKER_HPP
+#define _GREPLACE_TRACKER_HPP
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+#include "detector.hpp"
+#include "frame_context.hpp"
+#include "planner.hpp"
+#include "scheduler.hpp"
+
+namespace greplace {
+  /*
+   * Finds the face in each frame of a stream. The cascade runs, as the
+   * planner directs, only every detect_period frames, or sooner if tracking
+   * loses the face; in between the last detected face is followed by
+   * matching it against a window around where it was. A period of 1 detects
+   * on every frame. Frames the scheduler finds unchanged keep the last faces
+   * without either. With more than one face allowed there is no tracking or
+   * planning, and each frame the scheduler lets through is searched whole.
+   */
+  class FaceTracker {
+  public:
+    FaceTracker(int detect_period, double min_confidence,
+                int full_scan_period, int detect_scale,
+                double motion_threshold, double idle_after, int idle_period,
+                int max_faces);
+    /* Frames must be passed in capture order; FACES are largest first */
+    void locate(greplace::FrameContext & frame,
+                greplace::Detector & detector, int threshold,
+                std::vector<cv::Rect> & faces);
+    /* Prints how often, and how quickly, each method found the face */
+    void report(void) const;
+  private:
+    /* The single face, tracked or detected as detect_period says */
+    cv::Rect follow(greplace::FrameContext & frame,
+                    greplace::Detector & detector, int threshold);
+    cv::Rect track(greplace::FrameContext & frame, double & confidence);
+    int detect_period;
+    double min_confidence;
+    greplace::DetectionPlanner planner;
+    greplace::ActivityScheduler scheduler;
+    int max_faces;
+    int detect_scale;
+    int since_detection;
+    cv::Rect face;
+    std::vector<cv::Rect> found;
+    cv::Mat face_template;
+    cv::Mat response;
+    int detections;
+    int tracks;
+    double detect_ticks;
+    double track_ticks;
+  };
+}
+
+#endif